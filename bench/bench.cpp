@@ -0,0 +1,340 @@
+// Micro benchmarks. Build with optimizations, e.g.
+// cmake -DCMAKE_BUILD_TYPE=Release, and run ./bench.
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/Columnar.h"
+#include "../include/Json.h"
+#include "../include/JsonWriter.h"
+#include "../include/ParseCache.h"
+#include "../include/Projection.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+// Runs |fn| until at least half a second has passed and returns MB/s, given
+// that one call processes |bytes|.
+double throughput(size_t bytes, const std::function<void()> &fn) {
+  using Clock = std::chrono::steady_clock;
+  size_t iterations = 0;
+  const auto start = Clock::now();
+  std::chrono::duration<double> elapsed{};
+  do {
+    fn();
+    ++iterations;
+    elapsed = Clock::now() - start;
+  } while (elapsed.count() < 0.5);
+  return bytes * iterations / elapsed.count() / (1 << 20);
+}
+
+// The string serializer as it was before it copied runs in bulk: one char
+// at a time, and a stringstream per control character.
+void referenceSerializeString(const std::string &str, std::string &out) {
+  out += '"';
+  for (auto ch: str) {
+    switch (ch) {
+      case '\"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default: {
+        auto v = static_cast<unsigned char>(ch);
+        if (v < 0x20) {
+          std::stringstream ss;
+          ss << "\\u" << std::hex << std::setfill('0') << std::setw(4) << v;
+          out += ss.str();
+        } else {
+          out += ch;
+        }
+      }
+    }
+  }
+  out += '"';
+}
+
+// |count| strings of |size| bytes drawn from |alphabet|.
+Json::array corpus(size_t count, size_t size, const std::string &alphabet) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+  Json::array strings;
+  for (size_t i = 0; i != count; ++i) {
+    std::string str;
+    while (str.size() < size) str += alphabet[pick(rng)];
+    strings.emplace_back(std::move(str));
+  }
+  return strings;
+}
+
+void benchStrings(const char *name, const Json::array &strings) {
+  const Json json(strings);
+  const size_t bytes = json.serialize(true).size();
+  SerializeOptions compact;
+  compact.compact = true;
+  SerializeOptions asciiOnly = compact;
+  asciiOnly.asciiOnly = true;
+  // The output buffer is reused so that only the serializers are measured.
+  std::string out;
+  std::vector<std::string> raw;
+  for (const auto &s: strings) raw.push_back(s.toString());
+  const double reference = throughput(bytes, [&raw, &out] {
+    out.clear();
+    for (const auto &s: raw) referenceSerializeString(s, out);
+  });
+  const double current = throughput(bytes, [&json, &compact, &out] {
+    out.clear();
+    json.serialize(out, compact);
+  });
+  const double ascii = throughput(bytes, [&json, &asciiOnly, &out] {
+    out.clear();
+    json.serialize(out, asciiOnly);
+  });
+  printf("%-28s reference %8.1f MB/s  serialize %8.1f MB/s  asciiOnly "
+         "%8.1f MB/s\n", name, reference, current, ascii);
+}
+
+// |count| numbers: a third integers, a third prices with two decimals and a
+// third arbitrary doubles.
+Json::array numbers(size_t count) {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> any(-1e6, 1e6);
+  Json::array values;
+  for (size_t i = 0; i != count; ++i) {
+    switch (i % 3) {
+      case 0: values.emplace_back(static_cast<double>(rng() % 100000)); break;
+      case 1: values.emplace_back(static_cast<double>(rng() % 100000) / 100);
+        break;
+      default: values.emplace_back(any(rng));
+    }
+  }
+  return values;
+}
+
+void benchNumbers(const char *name, const Json::array &values) {
+  const Json json(values);
+  SerializeOptions compact;
+  compact.compact = true;
+  std::string out;
+  json.serialize(out, compact);
+  const size_t bytes = out.size();
+  std::vector<double> raw;
+  for (const auto &v: values) raw.push_back(v.toNumber());
+  size_t referenceBytes = 0;
+  const double reference = throughput(bytes, [&raw, &out, &referenceBytes] {
+    out.clear();
+    char buf[32];
+    out += '[';
+    for (auto v: raw) {
+      out.append(buf, snprintf(buf, sizeof(buf), "%.17g", v));
+      out += ',';
+    }
+    out.back() = ']';
+    referenceBytes = out.size();
+  });
+  const double current = throughput(bytes, [&json, &compact, &out] {
+    out.clear();
+    json.serialize(out, compact);
+  });
+  printf("%-28s reference %8.1f MB/s  serialize %8.1f MB/s  "
+         "(%zu bytes, %%.17g: %zu bytes)\n",
+         name, reference, current, bytes, referenceBytes);
+}
+
+// |count| records with |width| members each, some of them nested.
+std::string records(size_t count, size_t width) {
+  std::mt19937 rng(42);
+  Json::array array;
+  for (size_t i = 0; i != count; ++i) {
+    Json::object record;
+    record["id"] = Json(static_cast<int>(i));
+    record["ts"] = Json(1570000000.0 + i);
+    record["user"] = Json(Json::object{{"name", Json("user" + std::to_string(
+        rng() % 1000))}, {"bio", Json(std::string(64, 'b'))}});
+    for (size_t j = 0; j != width; ++j) {
+      const std::string key = "field" + std::to_string(j);
+      if (j % 4 == 0)
+        record[key] = Json(Json::array{Json(1.5), Json("x"), Json(nullptr)});
+      else if (j % 4 == 1) record[key] = Json(std::string(24, 's'));
+      else record[key] = Json(static_cast<double>(rng()));
+    }
+    array.emplace_back(std::move(record));
+  }
+  return Json(std::move(array)).serialize(true);
+}
+
+void benchProjection(const char *name, const std::string &text) {
+  std::string err;
+  const double full = throughput(text.size(), [&text, &err] {
+    Json::parse(text, err);
+  });
+  Projection projection{"id", "ts", "user.name"};
+  ParseOptions options;
+  options.projection = &projection;
+  const double projected = throughput(text.size(), [&text, &err, &options] {
+    Json::parse(text, err, options);
+  });
+  printf("%-28s parse %8.1f MB/s  projected parse %8.1f MB/s\n",
+         name, full, projected);
+}
+
+void benchParallel(const char *name, const std::string &text) {
+  std::string err;
+  const Json json = Json::parse(text, err);
+  SerializeOptions options;
+  options.compact = true;
+  std::string out;
+  const double single = throughput(text.size(), [&json, &options, &out] {
+    out.clear();
+    json.serialize(out, options);
+  });
+  options.threads = 0;
+  const double parallel = throughput(text.size(), [&json, &options, &out] {
+    out.clear();
+    json.serialize(out, options);
+  });
+  printf("%-28s serialize %8.1f MB/s  %u threads %8.1f MB/s\n", name, single,
+         std::thread::hardware_concurrency(), parallel);
+}
+
+void benchColumns(const char *name, const std::string &text) {
+  std::string err;
+  std::vector<int64_t> ids;
+  std::vector<double> ts;
+  const double pivot = throughput(text.size(), [&text, &err, &ids, &ts] {
+    ids.clear();
+    ts.clear();
+    const Json json = Json::parse(text, err);
+    for (size_t i = 0; i != json.size(); ++i) {
+      ids.push_back(json[i]["id"].toInt64());
+      ts.push_back(json[i]["ts"].toNumber());
+    }
+  });
+  Columns columns;
+  columns.add("id", ColumnType::kInt64);
+  columns.add("ts", ColumnType::kDouble);
+  const double extract = throughput(text.size(), [&text, &err, &columns] {
+    if (!columns.extract(text, err)) printf("%s\n", err.c_str());
+  });
+  printf("%-28s parse+pivot %8.1f MB/s  extract %8.1f MB/s\n",
+         name, pivot, extract);
+}
+
+void benchPacked(const char *name, const Json::array &values) {
+  const std::string text = Json(values).serialize(true);
+  std::string err;
+  ParseOptions options;
+  options.packArrays = false;
+  const double nodes = throughput(text.size(), [&text, &err, &options] {
+    Json::parse(text, err, options);
+  });
+  options.packArrays = true;
+  const double packed = throughput(text.size(), [&text, &err, &options] {
+    Json::parse(text, err, options);
+  });
+  printf("%-28s parse %8.1f MB/s  packed parse %8.1f MB/s\n",
+         name, nodes, packed);
+}
+
+// A response of |count| records, built as a Json and serialized, and written
+// with a JsonWriter.
+void benchWriter(const char *name, size_t count) {
+  SerializeOptions compact;
+  compact.compact = true;
+  std::string out;
+  const auto build = [count, &compact, &out] {
+    Json::array rows;
+    for (size_t i = 0; i != count; ++i) {
+      rows.emplace_back(Json::object{
+          {"id", Json(static_cast<int>(i))}, {"score", Json(i * 0.25)},
+          {"name", Json("user")}, {"active", Json(i % 2 == 0)}});
+    }
+    out.clear();
+    Json(Json::object{{"rows", Json(std::move(rows))}}).serialize(out, compact);
+  };
+  build();
+  const size_t bytes = out.size();
+  const double tree = throughput(bytes, build);
+  const double writer = throughput(bytes, [count, &compact, &out] {
+    out.clear();
+    JsonWriter w(out, compact);
+    w.startObject().key("rows").startArray();
+    for (size_t i = 0; i != count; ++i) {
+      w.startObject();
+      w.key("id").value(static_cast<int>(i)).key("score").value(i * 0.25);
+      w.key("name").value("user").key("active").value(i % 2 == 0);
+      w.endObject();
+    }
+    w.endArray().endObject();
+  });
+  printf("%-28s build+serialize %8.1f MB/s  writer %8.1f MB/s\n",
+         name, tree, writer);
+}
+
+// One character typed into a member of the middle record, parsed whole
+// again and reparsed around the edit.
+void benchReparse(const char *name, const std::string &text) {
+  std::string err;
+  const size_t offset = text.find("sss", text.size() / 2) + 1;
+  std::string edited = text;
+  Json json = Json::parse(edited, err);
+  bool flip = false;
+  const double full = throughput(text.size(), [&edited, &err, offset, &flip] {
+    edited[offset] = (flip = !flip) ? 't' : 's';
+    Json::parse(edited, err);
+  });
+  const double local = throughput(text.size(), [&edited, &json, &err, offset,
+                                                &flip] {
+    Json::reparse(json, edited, {offset, 1, (flip = !flip) ? "t" : "s"}, err);
+  });
+  printf("%-28s parse %8.1f MB/s  reparse %8.1f MB/s\n", name, full, local);
+}
+
+// Bodies drawn from a few distinct ones, as from polling clients.
+void benchCache(const char *name, const std::string &text) {
+  std::vector<std::string> bodies;
+  for (int i = 0; i != 8; ++i)
+    bodies.push_back("{\"client\": " + std::to_string(i) + ", \"data\": "
+                         + text + "}");
+  std::string err;
+  size_t next = 0;
+  const double direct = throughput(bodies[0].size(), [&bodies, &err, &next] {
+    Json::parse(bodies[next++ % bodies.size()], err);
+  });
+  ParseCache cache(64 << 20);
+  const double cached = throughput(bodies[0].size(), [&bodies, &err, &next,
+                                                      &cache] {
+    cache.parse(bodies[next++ % bodies.size()], err);
+  });
+  printf("%-28s parse %8.1f MB/s  cached parse %8.1f MB/s\n",
+         name, direct, cached);
+}
+
+} // namespace
+
+int main() {
+  const std::string prose =
+      "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789.,;";
+  benchStrings("long ASCII strings", corpus(256, 16384, prose));
+  benchStrings("long strings, some escapes",
+               corpus(256, 16384, prose + "\"\n"));
+  benchStrings("short strings", corpus(65536, 24, prose));
+  benchNumbers("numbers", numbers(1 << 18));
+  benchProjection("3 of 43 members", records(4096, 40));
+  benchParallel("records", records(16384, 40));
+  benchColumns("2 of 43 members", records(4096, 40));
+  benchPacked("number array", numbers(1 << 18));
+  benchWriter("response", 16384);
+  benchReparse("edited records", records(4096, 40));
+  benchCache("repeated bodies", records(64, 40));
+  return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef LIGHTJSON_COLUMNAR_H
+#define LIGHTJSON_COLUMNAR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Json.h"
+
+namespace lightjson {
+
+class Parser;
+
+enum class ColumnType {
+  kDouble,
+  kInt64,
+  kBool,
+  kString
+};
+
+// The values of one member across a record array, in contiguous storage.
+// Only the vector(s) of the column's type are filled, with one entry per row;
+// null rows hold 0, false or the empty string.
+struct Column {
+  Column(std::string name, ColumnType type)
+      : name(std::move(name)), type(type) {}
+
+  std::string name;
+  ColumnType type;
+  std::vector<double> doubles;
+  std::vector<int64_t> ints;
+  std::vector<uint8_t> bools;
+  // Row i of a string column is chars[offsets[i], offsets[i + 1]).
+  std::string chars;
+  std::vector<size_t> offsets;
+  // Bit i % 64 of word i / 64 is set if row i has a value. Rows are null if
+  // the member is missing or null.
+  std::vector<uint64_t> validity;
+  size_t nullCount = 0;
+
+  bool isNull(size_t row) const {
+    return !(validity[row / 64] >> (row % 64) & 1);
+  }
+  std::string stringAt(size_t row) const {
+    return chars.substr(offsets[row], offsets[row + 1] - offsets[row]);
+  }
+};
+
+// Pivots an array of objects, e.g. [{"ts": 1, "v": 0.5}, ...], into one
+// Column per requested member, without building a Json per value. The
+// columns are kept between calls to extract(), so their storage is reused.
+//
+//   Columns columns;
+//   columns.add("ts", ColumnType::kInt64);
+//   columns.add("v", ColumnType::kDouble);
+//   if (columns.extract(text, error)) use(columns[1].doubles);
+class Columns {
+ public:
+  Columns() = default;
+  // Make the Columns uncopiable, since it is meant to be reused.
+  Columns(const Columns &) = delete;
+  Columns &operator=(const Columns &) = delete;
+
+  // Adding a name again changes the type of its column.
+  void add(std::string name, ColumnType type);
+
+  // Reads the record array in one pass. Members that are not columns are
+  // skipped like those left out by a Projection, without being decoded. A
+  // value of the wrong type, e.g. a string in a kDouble column or a
+  // fraction in a kInt64 column, is an error. On error, false is returned
+  // with the error filled in and the columns are left empty.
+  bool extract(const std::string &text, std::string &error);
+  bool extract(const char *text, std::string &error);
+  // Same, from a parsed array.
+  bool extract(const Json &records, std::string &error);
+
+  size_t rows() const noexcept { return rows_; }
+  size_t size() const noexcept { return columns_.size(); }
+  const Column &operator[](size_t i) const { return columns_[i]; }
+  // nullptr if there is no such column.
+  const Column *find(const std::string &name) const;
+
+ private:
+  friend class Parser;
+
+  std::vector<Column> columns_;
+  std::unordered_map<std::string, size_t> index_;
+  size_t rows_ = 0;
+
+  bool extract(Parser &, std::string &);
+  void clear();
+  void beginRow();
+  void endRow();
+  // Discards what a duplicate key wrote to the current row before.
+  void rewind(Column &);
+  void appendNull(Column &);
+  void appendDouble(Column &, double);
+  void appendInt64(Column &, int64_t);
+  void appendBool(Column &, bool);
+  // Marks the current row valid once the value was appended.
+  void setValid(Column &);
+};
+
+} // namespace
+
+#endif //LIGHTJSON_COLUMNAR_H
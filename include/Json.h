@@ -6,6 +6,8 @@
 #define LIGHTJSON_JSON_H
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <memory>
 #include <vector>
@@ -14,8 +16,77 @@
 
 namespace lightjson {
 
-// Forward declaration for unique_ptr.
+// Forward declaration for shared_ptr.
 class JsonValue;
+class Columns;
+class Interner;
+class JsonWriter;
+class Parser;
+class ParserContext;
+class Projection;
+class SerializePlan;
+
+struct ParseOptions {
+  // Share structurally identical subtrees and strings while parsing, the same
+  // way Json::compact() does afterwards.
+  bool deduplicate = false;
+  // Reject text that is not valid UTF-8. Otherwise the bytes of strings are
+  // taken as they are.
+  bool strictUtf8 = false;
+  // Documents with more nested arrays/objects than this are rejected.
+  size_t maxDepth = 1000;
+  // Keep numbers as the text they were written as. They are converted only
+  // when read, and serialized unchanged. Otherwise integers that fit in 64
+  // bits are stored exactly and all other numbers as doubles.
+  bool rawNumbers = false;
+  // Build only the members on these paths. Skipped values are only scanned
+  // for the end of their brackets and strings, so errors inside them go
+  // unreported. Must outlive the parse.
+  const Projection *projection = nullptr;
+  // Store arrays of only numbers or only bools as one double or byte per
+  // element, see Json::packedNumbers(). Arrays holding an integer of 1e15 or
+  // more stay unpacked, since it would not be written back the same way.
+  bool packArrays = true;
+};
+
+// |removed| bytes of a text at |offset| replaced by |inserted|, see
+// Json::reparse().
+struct TextEdit {
+  size_t offset;
+  size_t removed;
+  std::string inserted;
+};
+
+struct SerializeOptions {
+  // Leave out the spaces after commas and colons.
+  bool compact = false;
+  // Write every non-ASCII character as a \uXXXX escape, as a surrogate pair
+  // above U+FFFF. Bytes that are not valid UTF-8 are written as U+FFFD.
+  bool asciiOnly = false;
+  // Large arrays and objects are split into chunks that are written on up to
+  // this many threads and joined in order. The output is the same either
+  // way. 0 uses one thread per core.
+  unsigned threads = 1;
+};
+
+// Heap bytes held by a Json tree, see Json::memoryUsage(). Allocator
+// overhead is not counted.
+struct MemoryUsage {
+  // The nodes, by type, e.g. nodes[static_cast<size_t>(JsonType::kString)],
+  // each with the shared_ptr control block it is allocated with.
+  size_t nodes[6] = {};
+  // The storage of arrays and objects: vector capacity, packed values, hash
+  // table buckets and entries.
+  size_t containers = 0;
+  // The characters of strings, keys and raw numbers. Short strings are held
+  // in the node itself and take none.
+  size_t strings = 0;
+  // The part of containers and strings that is allocated but unused, which
+  // shrink() gives back.
+  size_t slack = 0;
+
+  size_t total() const;
+};
 
 class Json {
  public:
@@ -26,7 +97,13 @@ class Json {
   Json() : Json(nullptr) {}
   Json(std::nullptr_t);
   Json(bool);
-  Json(int val) : Json(val * 1.0f) {}
+  // Integers are stored exactly, see toInt64()/toUint64().
+  Json(int);
+  Json(long);
+  Json(long long);
+  Json(unsigned);
+  Json(unsigned long);
+  Json(unsigned long long);
   Json(double);
   Json(const char *cStr) : Json(std::string(cStr)) {}
   Json(const std::string &);
@@ -47,7 +124,34 @@ class Json {
   ~Json();
   // Parse and serialize
   static Json parse(const std::string &, std::string &);
-  std::string serialize() const;
+  static Json parse(const std::string &, std::string &, const ParseOptions &);
+  // |compact| drops the blanks after ',' and ':'.
+  std::string serialize(bool compact = false) const;
+  std::string serialize(const SerializeOptions &) const;
+  // Appends to |out|, so that one buffer can be reused across documents.
+  void serialize(std::string &out, const SerializeOptions &) const;
+  // Applies |edit| to |text| and brings |json|, parsed from |text| with the
+  // same options, up to date with it. Only the innermost value around the
+  // edit is parsed again and replaced; every other node stays as it is. The
+  // result is the same as parsing the edited text in full, which is what
+  // happens if the edit changes the structure around it, e.g. by closing a
+  // string, or if a Projection is used. On invalid text, false is returned
+  // with the error filled in; the text is edited all the same, but the tree
+  // is left as it was and no longer matches it.
+  static bool reparse(Json &json,
+                      std::string &text,
+                      const TextEdit &edit,
+                      std::string &error,
+                      const ParseOptions &options = ParseOptions());
+  // Reformat JSON text in one pass, without building a Json. Object members
+  // keep their original order. On invalid input an empty string is returned
+  // and the error is filled in, same as parse().
+  static std::string minify(const std::string &, std::string &);
+  static std::string prettify(const std::string &, int indent, std::string &);
+  // Checks that the text is one JSON document (RFC 8259) in valid UTF-8 that
+  // parse() accepts with the default ParseOptions, without building a Json.
+  // Nothing is allocated unless the text is invalid.
+  static bool validate(const std::string &, std::string &);
 
   JsonType getType() const;
   bool isNull() const noexcept;
@@ -59,11 +163,69 @@ class Json {
 
   bool toBool() const;
   double toNumber() const;
+  // The exact value of an integer, however it is stored: 3.0 reads as 3.
+  // Throws if the number is not an integer or is out of range.
+  int64_t toInt64() const;
+  uint64_t toUint64() const;
   std::string toString() const;
   Json::array toArray() const;
   Json::object toObject() const;
 
   size_t size() const;
+  // Arrays of only numbers or only bools are stored packed by parse(), see
+  // ParseOptions::packArrays, and behave like any other array. These give
+  // direct access to the packed values: nullptr if the array is not packed,
+  // or no longer is since it was accessed through a non-const accessor.
+  const std::vector<double> *packedNumbers() const;
+  const std::vector<uint8_t> *packedBools() const;
+
+  // In-place mutation. Like the accessors, array operations throw on anything
+  // but an array and object operations throw on anything but an object.
+  void push_back(const Json &);
+  void push_back(Json &&);
+  template<typename... Args>
+  Json &emplace_back(Args &&... args) {
+    push_back(Json(std::forward<Args>(args)...));
+    return (*this)[size() - 1];
+  }
+  void insert(size_t, const Json &);
+  void insert(size_t, Json &&);
+  void erase(size_t);
+  // insert() and emplace() keep an existing member and return false,
+  // insert_or_assign() overwrites it.
+  bool insert(std::string, const Json &);
+  bool insert(std::string, Json &&);
+  template<typename... Args>
+  bool emplace(std::string key, Args &&... args) {
+    return insert(std::move(key), Json(std::forward<Args>(args)...));
+  }
+  Json &insert_or_assign(std::string, const Json &);
+  Json &insert_or_assign(std::string, Json &&);
+  size_t erase(const std::string &);
+  void clear();
+
+  // Makes structurally identical subtrees and strings of this tree share one
+  // node each, which shrinks repetitive documents considerably. Shared nodes
+  // are copied on write, so the tree can still be modified as usual, but
+  // references to children taken before compact() must not be used to modify
+  // them afterwards.
+  void compact();
+  // What the tree takes up. Nodes shared within it, e.g. after compact(), are
+  // counted once.
+  MemoryUsage memoryUsage() const;
+  // Gives back the slack left over from parsing or modification: trims
+  // vectors and strings to their size and rehashes objects to theirs. Nodes
+  // shared with another Json, which may be reading them, are left as they
+  // are. Like modification, this invalidates references into the tree.
+  void shrink();
+
+  // RFC 7386 JSON Merge Patch, applied in place.
+  void mergePatch(const Json &);
+  void mergePatch(Json &&);
+  // RFC 6902 JSON Patch, applied in place. The operations run in order; if
+  // one fails, false is returned with the error filled in and the operations
+  // before it stay applied.
+  bool applyPatch(const Json &, std::string &);
 
   // operators
   // random access
@@ -72,7 +234,35 @@ class Json {
   // key-val access
   Json &operator[](const std::string &);
   const Json &operator[](const std::string &) const;
-  // Comparison
+  // String literals, e.g. json["id"], are looked up the same way as keys
+  // given as a pointer and a size, see find().
+  template<size_t N>
+  Json &operator[](const char (&key)[N]) { return lookup(key, strlen(key)); }
+  template<size_t N>
+  const Json &operator[](const char (&key)[N]) const {
+    return lookup(key, strlen(key));
+  }
+  // Same as operator[], but returns nullptr if the key does not exist. Keys
+  // given as a pointer and a size are still copied: std::unordered_map can
+  // only be probed with a std::string before C++20. They are copied into a
+  // buffer each thread reuses, so only a key longer than any before it on
+  // the thread allocates.
+  Json *find(const std::string &);
+  const Json *find(const std::string &) const;
+  Json *find(const char *key, size_t size);
+  const Json *find(const char *key, size_t size) const;
+  // Structural hash. Equal values hash equal, regardless of the member order
+  // of their objects. It is computed on first use and cached in every node it
+  // visits. Modifying a value through this Json drops the cache of each
+  // container on the way, so a reference to a child taken before hash() must
+  // not be used to modify it after, or its parents' hashes go stale.
+  size_t hash() const;
+  // JSON Pointers (RFC 6901) to the values that were added, removed or
+  // changed from the first document to the second. Subtrees with equal hashes
+  // are compared once and, if they are equal, not descended into.
+  static std::vector<std::string> diff(const Json &, const Json &);
+  // Comparison. Numbers compare by value, so Json(1) == Json(1.0), but
+  // integers are not rounded: 2^53 + 1 differs from the double 2^53.
   bool operator==(const Json &) const;
   inline bool operator!=(const Json &o) {
     return !(this->operator==(o));
@@ -89,13 +279,48 @@ class Json {
   }
 
  private:
+  friend class Columns;
+  friend class Interner;
+  friend class JsonWriter;
+  friend class Parser;
+  friend class ParserContext;
+
+  explicit Json(std::shared_ptr<JsonValue> value) : value_(std::move(value)) {}
+  // Reads go through value(). Writes go through mutableValue(), which unshares
+  // the node first.
+  const JsonValue &value() const;
+  JsonValue &mutableValue();
   void swap(Json &) noexcept;
-  std::string serializeNumber() const;
-  std::string serializeString() const;
-  std::string serializeArray() const;
-  std::string serializeObject() const;
+  Json &lookup(const char *, size_t);
+  const Json &lookup(const char *, size_t) const;
+  void applyPatchOperation(const Json &);
+  void applyPatchValue(const std::string &,
+                       const std::vector<std::string> &,
+                       const std::string &,
+                       Json &);
+  Json *resolvePointer(const std::vector<std::string> &, size_t);
+  static void diff(const Json &,
+                   const Json &,
+                   std::string &,
+                   std::vector<std::string> &);
+  // Serializers append to the output buffer instead of returning a string per
+  // node.
+  void serializeTree(std::string &, const SerializeOptions &) const;
+  void serializeParallel(std::string &,
+                         const SerializeOptions &,
+                         unsigned threads) const;
+  void planParallel(SerializePlan &, const SerializeOptions &, size_t depth)
+      const;
+  void serializeNumber(std::string &) const;
+  static void serializePacked(const JsonValue &, std::string &, const char *);
+  static void serializeString(const std::string &str,
+                              std::string &out,
+                              bool asciiOnly) {
+    serializeString(str.data(), str.size(), out, asciiOnly);
+  }
+  static void serializeString(const char *, size_t, std::string &, bool);
   // PIMPL
-  std::unique_ptr<JsonValue> value_;
+  std::shared_ptr<JsonValue> value_;
 };
 
 } // namespace
@@ -0,0 +1,79 @@
+#ifndef LIGHTJSON_JSONSNAPSHOT_H
+#define LIGHTJSON_JSONSNAPSHOT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Json.h"
+
+namespace lightjson {
+
+// A frozen Json that any number of threads may read at once. Structural
+// hashes are computed up front, so even equality, hash() and diff() only read
+// the tree. Copying the root out is fine as well, and the copy can be modified
+// like any other Json. It is a deep copy, except for subtrees that are already
+// shared, e.g. after compact() or a parse with ParseOptions::deduplicate.
+class JsonSnapshot {
+ public:
+  using Ptr = std::shared_ptr<const JsonSnapshot>;
+
+  static Ptr create(Json json);
+
+  const Json &root() const noexcept { return root_; }
+  const Json &operator[](size_t i) const { return root_[i]; }
+  const Json &operator[](const std::string &key) const { return root_[key]; }
+  size_t hash() const noexcept { return hash_; }
+
+ private:
+  explicit JsonSnapshot(Json &&json);
+
+  const Json root_;
+  const size_t hash_;
+};
+
+// Holds the current snapshot of a value that is replaced every now and then,
+// e.g. a configuration that is reloaded. Both load() and publish() may be
+// called from any thread. load() is lock-free: it claims the current snapshot
+// with an atomic add, copies the shared_ptr out and gives the claim back.
+// publish() and reclaim() take a lock, but only against each other.
+//
+// A replaced snapshot is kept alive until the readers that loaded it are
+// done, and is then destroyed by the next publish() or reclaim() rather than
+// by whichever reader happens to let go of it last. That way readers never
+// pay for tearing down a tree.
+class AtomicSnapshot {
+ public:
+  AtomicSnapshot();
+  explicit AtomicSnapshot(JsonSnapshot::Ptr snapshot);
+  ~AtomicSnapshot();
+  // Make the AtomicSnapshot uncopiable.
+  AtomicSnapshot(const AtomicSnapshot &) = delete;
+  AtomicSnapshot &operator=(const AtomicSnapshot &) = delete;
+
+  JsonSnapshot::Ptr load() const;
+  void publish(Json json) { publish(JsonSnapshot::create(std::move(json))); }
+  void publish(JsonSnapshot::Ptr);
+  // Destroys the replaced snapshots nobody reads anymore. Returns how many
+  // are still in use.
+  size_t reclaim();
+
+ private:
+  struct Holder;
+
+  // The address of the current Holder, and in the top bits the number of
+  // load()s that have claimed it and not yet given it back.
+  mutable std::atomic<uint64_t> current_;
+  // Serializes publish() and reclaim().
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Holder>> retired_;
+
+  size_t reclaimLocked();
+};
+
+} // namespace
+
+#endif //LIGHTJSON_JSONSNAPSHOT_H
@@ -0,0 +1,113 @@
+#ifndef LIGHTJSON_JSONSTREAM_H
+#define LIGHTJSON_JSONSTREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Json.h"
+#include "ParserContext.h"
+
+namespace lightjson {
+
+enum class Compression {
+  // gzip or zstd if the stream starts with their magic number, else none.
+  kAuto,
+  kNone,
+  // gzip, or zlib with its header.
+  kGzip,
+  kZstd
+};
+
+struct StreamOptions {
+  Compression compression = Compression::kAuto;
+  // Decompressed text is handed over in chunks of this size. At most
+  // maxChunks of them wait to be parsed; decompression pauses until the
+  // parser catches up, so memory stays at about (maxChunks + 2) * chunkSize
+  // plus the longest record, however long the stream.
+  size_t chunkSize = 256 * 1024;
+  size_t maxChunks = 4;
+  ParseOptions parse;
+};
+
+// Parses a possibly compressed stream, e.g. an archived .ndjson.gz, while it
+// is decompressed: one thread reads and decompresses, the caller's thread
+// parses the chunks it hands over.
+//
+//   JsonStream stream([file](char *buf, size_t size) {
+//     return fread(buf, 1, size, file);
+//   });
+//   Json record;
+//   std::string error;
+//   while (stream.next(record, error)) use(record);
+//   if (!error.empty()) ...
+//
+// gzip needs LightJson to be built with zlib, zstd with libzstd, see
+// LIGHTJSON_WITH_ZLIB and LIGHTJSON_WITH_ZSTD in CMakeLists.txt.
+class JsonStream {
+ public:
+  // Fills the buffer with up to |size| bytes of the stream and returns how
+  // many it wrote, 0 at the end. Called on the decompression thread.
+  using Source = std::function<size_t(char *, size_t)>;
+
+  explicit JsonStream(Source source,
+                      const StreamOptions &options = StreamOptions());
+  // Stops decompressing, without reading the rest of the stream. A call to
+  // the source that is in progress can't be interrupted, so this waits for
+  // it to return: a source that may block for long, e.g. on a socket, must
+  // be unblocked first, e.g. by shutting the socket down.
+  ~JsonStream();
+  // Make the JsonStream uncopiable.
+  JsonStream(const JsonStream &) = delete;
+  JsonStream &operator=(const JsonStream &) = delete;
+
+  // The next record of NDJSON, one document per line; blank lines are
+  // skipped. Returns false at the end of the stream, or with the error filled
+  // in, e.g. "Line 3: Invalid value: ...", if a record or the compressed
+  // data is invalid. The stream ends at the first error.
+  bool next(Json &, std::string &error);
+  // The rest of the stream as one document, the same as Json::parse(). The
+  // parser needs the document whole, so this holds all of its text at once.
+  Json parse(std::string &error);
+
+ private:
+  Source source_;
+  const StreamOptions options_;
+  ParserContext context_;
+
+  // Shared with the decompression thread.
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable space_;
+  std::deque<std::string> chunks_;
+  // Buffers handed back by the parser, so chunks are not allocated anew.
+  std::vector<std::string> spare_;
+  bool finished_ = false;
+  bool stopping_ = false;
+  std::string streamError_;
+  std::thread thread_;
+
+  // Owned by the caller's thread: text not parsed yet starts at data_[pos_],
+  // and has no newline before data_[scanned_].
+  std::string data_;
+  size_t pos_ = 0;
+  size_t scanned_ = 0;
+  size_t line_ = 0;
+  std::string record_;
+  bool ended_ = false;
+  std::string error_;
+
+  void decompress();
+  bool push(std::string &chunk);
+  bool stopping();
+  std::string spare();
+  bool take(std::string &chunk);
+};
+
+} // namespace
+
+#endif //LIGHTJSON_JSONSTREAM_H
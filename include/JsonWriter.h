@@ -0,0 +1,97 @@
+#ifndef LIGHTJSON_JSONWRITER_H
+#define LIGHTJSON_JSONWRITER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include "Json.h"
+#include "../src/BitStack.h"
+
+namespace lightjson {
+
+// Writes JSON text straight into a buffer, without building a Json. Commas
+// and colons are put in as needed, and strings and numbers are written the
+// same way serialize() writes them.
+//
+//   std::string out;
+//   JsonWriter writer(out);
+//   writer.startObject();
+//   writer.key("id").value(7);
+//   writer.key("tags").startArray().value("a").value("b").endArray();
+//   writer.endObject();
+//
+// Builds without NDEBUG assert that the calls nest: keys only directly in
+// objects, one value per key, ends that match their starts and a single root
+// value. Release builds don't check, and produce invalid JSON if misused.
+class JsonWriter {
+ public:
+  // Sink for the streaming constructor.
+  using Sink = std::function<void(const char *, size_t)>;
+
+  // Appends to |out|. Only |compact| and |asciiOnly| of the options are
+  // used, except by value(const Json &).
+  explicit JsonWriter(std::string &out,
+                      const SerializeOptions &options = SerializeOptions());
+  // Hands the text to |sink| in pieces of at least |bufferSize| bytes, and
+  // the rest once the root value is complete or on flush().
+  explicit JsonWriter(Sink sink,
+                      size_t bufferSize = 64 * 1024,
+                      const SerializeOptions &options = SerializeOptions());
+  // Make the JsonWriter uncopiable.
+  JsonWriter(const JsonWriter &) = delete;
+  JsonWriter &operator=(const JsonWriter &) = delete;
+
+  JsonWriter &startObject();
+  JsonWriter &endObject();
+  JsonWriter &startArray();
+  JsonWriter &endArray();
+  JsonWriter &key(const std::string &);
+  JsonWriter &key(const char *);
+  JsonWriter &key(const char *, size_t);
+
+  JsonWriter &value(std::nullptr_t);
+  JsonWriter &value(bool);
+  JsonWriter &value(int);
+  JsonWriter &value(long);
+  JsonWriter &value(long long);
+  JsonWriter &value(unsigned);
+  JsonWriter &value(unsigned long);
+  JsonWriter &value(unsigned long long);
+  JsonWriter &value(double);
+  JsonWriter &value(const std::string &);
+  JsonWriter &value(const char *);
+  JsonWriter &value(const char *, size_t);
+  // Writes a whole tree, e.g. a part of the response that is a Json already.
+  JsonWriter &value(const Json &);
+
+  // Hands what is buffered to the sink. Does nothing when writing to a
+  // string.
+  void flush();
+  // Whether the root value is complete.
+  bool done() const noexcept { return done_; }
+
+ private:
+  std::string buffer_;
+  std::string *out_;
+  Sink sink_;
+  size_t bufferSize_ = 0;
+  SerializeOptions options_;
+  // One bit per open container, set for objects.
+  BitStack nesting_;
+  // Nothing was written to the innermost container yet.
+  bool first_ = true;
+  // A key was written and its value was not.
+  bool afterKey_ = false;
+  bool done_ = false;
+
+  void beginValue();
+  void endValue();
+  void startContainer(bool isObject);
+  void endContainer(bool isObject);
+  JsonWriter &integer(int64_t);
+  JsonWriter &integer(uint64_t);
+};
+
+} // namespace
+
+#endif //LIGHTJSON_JSONWRITER_H
@@ -0,0 +1,76 @@
+#ifndef LIGHTJSON_PARSECACHE_H
+#define LIGHTJSON_PARSECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Json.h"
+#include "JsonSnapshot.h"
+
+namespace lightjson {
+
+struct ParseCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  // What the cached texts and trees take up, see ParseCache().
+  size_t bytes = 0;
+};
+
+// Parses through a cache of recently seen texts, for traffic where many
+// bodies are byte for byte the same, e.g. polling clients and retries. Texts
+// are looked up by a hash of their content and compared in full, so a hit
+// always returns the document the text parses to. Documents are shared
+// between callers as JsonSnapshots, which any number of threads may read.
+//
+//   ParseCache cache(64 << 20);
+//   std::string error;
+//   if (auto doc = cache.parse(body, error)) handle(doc->root());
+//
+// Any thread may call parse(). Texts are hashed and parsed outside of the
+// cache's lock, which is held only to look them up and to insert them.
+class ParseCache {
+ public:
+  // The least recently used documents are evicted to keep the texts, the
+  // trees (see Json::memoryUsage()) and the cache's own bookkeeping under
+  // |budget| bytes. A document larger than that on its own is not cached.
+  explicit ParseCache(size_t budget,
+                      const ParseOptions &options = ParseOptions());
+  // Make the ParseCache uncopiable.
+  ParseCache(const ParseCache &) = delete;
+  ParseCache &operator=(const ParseCache &) = delete;
+
+  // Same as Json::parse(), but returns nullptr with the error filled in on
+  // invalid text. Invalid texts are not cached.
+  JsonSnapshot::Ptr parse(const std::string &text, std::string &error);
+  ParseCacheStats stats() const;
+  // Drops every document. The counters are kept.
+  void clear();
+
+ private:
+  struct Entry {
+    size_t hash;
+    std::string text;
+    JsonSnapshot::Ptr json;
+    size_t bytes;
+  };
+
+  const size_t budget_;
+  const ParseOptions options_;
+  mutable std::mutex mutex_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_multimap<size_t, std::list<Entry>::iterator> index_;
+  ParseCacheStats stats_;
+
+  JsonSnapshot::Ptr findLocked(size_t hash, const std::string &text);
+  void evictLocked(std::list<Entry> &evicted);
+};
+
+} // namespace
+
+#endif //LIGHTJSON_PARSECACHE_H
@@ -0,0 +1,90 @@
+#ifndef LIGHTJSON_PARSEPOOL_H
+#define LIGHTJSON_PARSEPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Json.h"
+
+namespace lightjson {
+
+// One document parsed by a ParsePool, the same as Json::parse() returns it.
+struct ParseResult {
+  Json json;
+  // Empty on success.
+  std::string error;
+};
+
+// Parses batches of independent documents, e.g. the bodies of the requests
+// that came in at once, on a pool of threads. Each thread parses with a
+// ParserContext of its own, so scratch buffers and nodes are reused across
+// documents. A batch is dealt out largest document first, and threads that
+// run out of work steal from the others, so one huge document holds up only
+// the thread that parses it.
+//
+//   ParsePool pool(4);
+//   auto results = pool.parse(bodies);
+//   for (auto &result: results) handle(result.get());
+class ParsePool {
+ public:
+  using Callback = std::function<void(size_t index, ParseResult &&)>;
+
+  // 0 threads uses one per core.
+  explicit ParsePool(unsigned threads = 0,
+                     const ParseOptions &options = ParseOptions());
+  // Waits for the documents already handed in.
+  ~ParsePool();
+  // Make the ParsePool uncopiable.
+  ParsePool(const ParsePool &) = delete;
+  ParsePool &operator=(const ParsePool &) = delete;
+
+  // One future per text, in order. The texts are not copied: they must stay
+  // alive until their documents are parsed.
+  std::vector<std::future<ParseResult>> parse(
+      const std::vector<std::string> &texts);
+  // Same, but calls |done| with the index of each text as soon as it is
+  // parsed, on the thread that parsed it. |done| must not throw.
+  void parse(const std::vector<std::string> &texts, Callback done);
+  // Blocks until every document handed in so far is parsed.
+  void wait();
+
+  unsigned threads() const noexcept {
+    return static_cast<unsigned>(workers_.size());
+  }
+
+ private:
+  struct Task {
+    const std::string *text;
+    std::function<void(ParseResult &&)> done;
+  };
+  struct Worker;
+
+  const ParseOptions options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  // Only guards stopping_, and the waits on wake_ and idle_.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  // Tasks in the queues, and tasks not done yet.
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> unfinished_{0};
+  bool stopping_ = false;
+
+  void submit(const std::vector<std::string> &texts,
+              const std::function<std::function<void(ParseResult &&)>(size_t)>
+              &makeDone);
+  void run(size_t worker);
+  bool take(size_t self, Task &);
+};
+
+} // namespace
+
+#endif //LIGHTJSON_PARSEPOOL_H
@@ -0,0 +1,88 @@
+#ifndef LIGHTJSON_PARSERCONTEXT_H
+#define LIGHTJSON_PARSERCONTEXT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Json.h"
+
+namespace lightjson {
+
+class NodePool;
+
+// Keeps parser state alive between documents, for workloads that parse many
+// small documents of a similar shape. A context remembers how big the
+// containers at each depth have been and reserves accordingly, reuses
+// one scratch buffer for decoding strings, and allocates nodes from a free
+// list. recycle() hands the containers and strings of a tree that is no
+// longer needed back to the context, so the next parse can fill them again
+// instead of allocating.
+//
+// A context must only be used by one thread at a time. The trees it returns
+// are ordinary Json values: they may outlive the context and may be copied,
+// modified and destroyed on any thread.
+class ParserContext {
+ public:
+  ParserContext();
+  ~ParserContext();
+  // Make the ParserContext uncopiable.
+  ParserContext(const ParserContext &) = delete;
+  ParserContext &operator=(const ParserContext &) = delete;
+
+  // Same as Json::parse().
+  Json parse(const std::string &, std::string &);
+  Json parse(const std::string &, std::string &, const ParseOptions &);
+  // Takes the storage of |json| for later documents. Subtrees that are still
+  // shared with another Json are left alone.
+  void recycle(Json &&json);
+
+ private:
+  friend class Parser;
+
+  // A container being filled by the parser. Frames are kept around once they
+  // exist, so that the stack and the key buffers are only allocated for the
+  // first document that nests this deep.
+  struct Frame {
+    Json::array array;
+    Json::object object;
+    std::string key;
+    bool isObject = false;
+    // What the members are filtered by, see Projection.
+    size_t projection = 0;
+    // Arrays are filled in here for as long as they hold only numbers or
+    // only bools, see ParseOptions::packArrays.
+    enum class Packing { kNone, kEmpty, kNumbers, kBools } packing;
+    std::vector<double> numbers;
+    std::vector<uint8_t> bools;
+  };
+
+  // Upper bounds on what is kept around between documents.
+  static constexpr size_t kMaxRecycled = 1024;
+  static constexpr size_t kMaxRecycledCapacity = 4096;
+
+  std::string scratch_;
+  std::vector<Frame> frames_;
+  // What to reserve for the arrays/objects at each depth: the smaller of the
+  // last two sizes seen there, so that one outlier is not reserved for again,
+  // and never more than is kept around for reuse.
+  struct SizeHint {
+    size_t last = 0;
+    size_t reserve = 0;
+  };
+  std::vector<SizeHint> arraySizes_;
+  std::vector<SizeHint> objectSizes_;
+  std::vector<Json::array> arrays_;
+  std::vector<Json::object> objects_;
+  std::vector<std::string> strings_;
+  std::vector<Json> pending_;
+  NodePool *pool_;
+
+  Json::array takeArray(size_t depth);
+  Json::object takeObject(size_t depth);
+  std::string takeString(const std::string &);
+  void recordSize(std::vector<SizeHint> &, size_t depth, size_t size);
+};
+
+} // namespace
+
+#endif //LIGHTJSON_PARSERCONTEXT_H
@@ -0,0 +1,57 @@
+#ifndef LIGHTJSON_PROJECTION_H
+#define LIGHTJSON_PROJECTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lightjson {
+
+// The members to keep while parsing, see ParseOptions::projection. Objects
+// only get the members on one of the paths; the value at the end of a path is
+// kept whole. Arrays are looked through: a projection that applies to an
+// array applies to each of its elements. Everything else is skipped without
+// being decoded or allocated, so parsing costs roughly in proportion to what
+// is kept.
+//
+//   Projection projection{"id", "ts", "user.name"};
+//   ParseOptions options;
+//   options.projection = &projection;
+//   auto json = Json::parse(text, error, options);
+class Projection {
+ public:
+  Projection();
+  Projection(std::initializer_list<std::string> paths);
+
+  // Keeps the value at |path|, a dot-separated list of keys such as
+  // "user.name".
+  void add(const std::string &path);
+  // Same, for keys that contain dots.
+  void add(const std::vector<std::string> &keys);
+
+ private:
+  friend class Parser;
+
+  // What a container is filtered by: a node of the trie below, or kAll.
+  static constexpr size_t kAll = SIZE_MAX;
+  // Returned by member() for keys that are not projected.
+  static constexpr size_t kSkip = SIZE_MAX - 1;
+
+  // A trie of the paths. Node 0 is the root.
+  struct Node {
+    std::unordered_map<std::string, size_t> children;
+    // A path ends here.
+    bool keepAll = false;
+  };
+  std::vector<Node> nodes_;
+
+  // What the member |key| of an object filtered by |node| is filtered by.
+  size_t member(size_t node, const std::string &key) const;
+};
+
+} // namespace
+
+#endif //LIGHTJSON_PROJECTION_H
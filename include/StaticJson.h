@@ -0,0 +1,638 @@
+#ifndef LIGHTJSON_STATICJSON_H
+#define LIGHTJSON_STATICJSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "Json.h"
+#include "../src/JsonException.h"
+
+namespace lightjson {
+
+// Parses a JSON string literal at compile time into a StaticJson, which holds
+// the document as plain read-only data: nothing is parsed or allocated when
+// the program runs. Invalid JSON fails to compile, with the parser's error,
+// e.g. "Missing colon", in the compiler's notes.
+//
+//   constexpr auto kDefaults = LIGHTJSON_STATIC_JSON(R"({"port": 8080})");
+//   static_assert(kDefaults["port"].toInt64() == 8080);
+//   server.listen(kDefaults["port"].toInt64());
+//
+// The text must be a constant expression: a literal, or a constexpr char
+// array or std::string_view.
+#define LIGHTJSON_STATIC_JSON(text)                                   \
+  (::lightjson::StaticJson<::lightjson::StaticParser::count(text).nodes, \
+                           ::lightjson::StaticParser::count(text).chars>(text))
+
+// Reports what is wrong with a static document. Reached during constant
+// evaluation, it stops the compilation.
+[[noreturn]] inline void staticJsonError(const std::string &error) {
+  throw JsonException(error);
+}
+
+// One value of a static document. Values are stored in document order, each
+// followed by its elements or members, so the children of a container are
+// found by hopping over the subtrees before them.
+struct StaticNode {
+  enum class Number { kInt64, kUint64, kDouble };
+
+  JsonType type = JsonType::kNull;
+  bool boolean = false;
+  // Numbers are stored the way Json::parse() stores them: integers exactly if
+  // they fit in 64 bits, everything else as doubles.
+  Number number = Number::kInt64;
+  int64_t int64 = 0;
+  uint64_t uint64 = 0;
+  double real = 0;
+  // The characters of a string.
+  size_t offset = 0;
+  size_t length = 0;
+  // The key of an object member.
+  size_t keyOffset = 0;
+  size_t keyLength = 0;
+  // A member whose key comes up again later in its object. Like in Json, the
+  // last one wins.
+  bool shadowed = false;
+  // The elements or members of a container.
+  size_t size = 0;
+  // The first node after this one's subtree.
+  size_t end = 0;
+};
+
+// A read-only value of a StaticJson, with the same accessors as a const Json.
+// Like the document, every accessor can be used at compile time.
+class StaticJsonView {
+ public:
+  constexpr StaticJsonView(const StaticNode *nodes,
+                           const char *chars,
+                           size_t index)
+      : nodes_(nodes), chars_(chars), index_(index) {}
+
+  constexpr JsonType getType() const noexcept { return node().type; }
+  constexpr bool isNull() const noexcept { return is(JsonType::kNull); }
+  constexpr bool isBool() const noexcept { return is(JsonType::kBool); }
+  constexpr bool isNumber() const noexcept { return is(JsonType::kNumber); }
+  constexpr bool isString() const noexcept { return is(JsonType::kString); }
+  constexpr bool isArray() const noexcept { return is(JsonType::kArray); }
+  constexpr bool isObject() const noexcept { return is(JsonType::kObject); }
+
+  constexpr bool toBool() const {
+    if (!isBool()) staticJsonError("Not implemented");
+    return node().boolean;
+  }
+  constexpr double toNumber() const {
+    if (!isNumber()) staticJsonError("Not implemented");
+    switch (node().number) {
+      case StaticNode::Number::kInt64:
+        return static_cast<double>(node().int64);
+      case StaticNode::Number::kUint64:
+        return static_cast<double>(node().uint64);
+      default: return node().real;
+    }
+  }
+  // The exact value of an integer, however it is stored: 3.0 reads as 3.
+  // Throws if the number is not an integer or is out of range.
+  constexpr int64_t toInt64() const {
+    if (!isNumber()) staticJsonError("Not implemented");
+    const auto &n = node();
+    if (n.number == StaticNode::Number::kInt64) return n.int64;
+    // -2^63 <= real < 2^63, and no fraction.
+    if (n.number == StaticNode::Number::kDouble
+        && -9223372036854775808.0 <= n.real && n.real < 9223372036854775808.0
+        && static_cast<double>(static_cast<int64_t>(n.real)) == n.real)
+      return static_cast<int64_t>(n.real);
+    staticJsonError("Number is not a 64-bit integer");
+  }
+  constexpr uint64_t toUint64() const {
+    if (!isNumber()) staticJsonError("Not implemented");
+    const auto &n = node();
+    if (n.number == StaticNode::Number::kUint64) return n.uint64;
+    if (n.number == StaticNode::Number::kInt64 && n.int64 >= 0)
+      return static_cast<uint64_t>(n.int64);
+    if (n.number == StaticNode::Number::kDouble
+        && 0 <= n.real && n.real < 18446744073709551616.0
+        && static_cast<double>(static_cast<uint64_t>(n.real)) == n.real)
+      return static_cast<uint64_t>(n.real);
+    staticJsonError("Number is not an unsigned 64-bit integer");
+  }
+  // Unlike Json::toString(), the characters are not copied.
+  constexpr std::string_view toString() const {
+    if (!isString()) staticJsonError("Not implemented");
+    return std::string_view(chars_ + node().offset, node().length);
+  }
+
+  constexpr size_t size() const {
+    if (!isArray() && !isObject()) staticJsonError("Not implemented");
+    return node().size;
+  }
+  // Elements and members are looked up by walking them in order, which suits
+  // the small documents this is meant for.
+  constexpr StaticJsonView operator[](size_t i) const {
+    if (!isArray()) staticJsonError("Not implemented");
+    if (i >= node().size) staticJsonError("Index out of range");
+    size_t child = index_ + 1;
+    for (; i; --i) child = nodes_[child].end;
+    return StaticJsonView(nodes_, chars_, child);
+  }
+  constexpr StaticJsonView operator[](std::string_view key) const {
+    const auto value = find(key);
+    if (!value) staticJsonError("Key " + std::string(key) + " does not exist");
+    return *value;
+  }
+  // Same as operator[], but empty if the key does not exist.
+  constexpr std::optional<StaticJsonView> find(std::string_view key) const {
+    if (!isObject()) staticJsonError("Not implemented");
+    for (size_t child = index_ + 1; child != node().end;
+         child = nodes_[child].end) {
+      const auto &member = nodes_[child];
+      if (!member.shadowed
+          && std::string_view(chars_ + member.keyOffset, member.keyLength)
+              == key)
+        return StaticJsonView(nodes_, chars_, child);
+    }
+    return std::nullopt;
+  }
+  // The members of an object, in the order they are written in.
+  constexpr std::pair<std::string_view, StaticJsonView> member(size_t i) const {
+    if (!isObject()) staticJsonError("Not implemented");
+    if (i >= node().size) staticJsonError("Index out of range");
+    size_t child = index_ + 1;
+    for (;; child = nodes_[child].end) {
+      if (nodes_[child].shadowed) continue;
+      if (!i--) break;
+    }
+    const auto &member = nodes_[child];
+    return {std::string_view(chars_ + member.keyOffset, member.keyLength),
+            StaticJsonView(nodes_, chars_, child)};
+  }
+
+  // A Json copy of the value, for code that takes one. This one allocates.
+  Json toJson() const {
+    switch (getType()) {
+      case JsonType::kNull: return Json(nullptr);
+      case JsonType::kBool: return Json(toBool());
+      case JsonType::kNumber:
+        switch (node().number) {
+          case StaticNode::Number::kInt64:
+            return Json(static_cast<long long>(node().int64));
+          case StaticNode::Number::kUint64:
+            return Json(static_cast<unsigned long long>(node().uint64));
+          default: return Json(node().real);
+        }
+      case JsonType::kString: return Json(std::string(toString()));
+      case JsonType::kArray: {
+        Json::array array;
+        array.reserve(size());
+        for (size_t child = index_ + 1; child != node().end;
+             child = nodes_[child].end)
+          array.push_back(StaticJsonView(nodes_, chars_, child).toJson());
+        return Json(std::move(array));
+      }
+      default: {
+        Json::object object;
+        for (size_t i = 0; i != size(); ++i) {
+          const auto member = this->member(i);
+          object.emplace(std::string(member.first), member.second.toJson());
+        }
+        return Json(std::move(object));
+      }
+    }
+  }
+
+ private:
+  const StaticNode *nodes_;
+  const char *chars_;
+  size_t index_;
+
+  constexpr const StaticNode &node() const { return nodes_[index_]; }
+  constexpr bool is(JsonType type) const { return node().type == type; }
+};
+
+// The parser behind LIGHTJSON_STATIC_JSON. It accepts what Json::parse()
+// accepts with the default ParseOptions, except for numbers that a double
+// cannot be computed exactly for at compile time: those with more than 19
+// significant digits, or whose digits times a power of ten above 1e22 or
+// below 1e-22 do not fit a double exactly. Integers that fit in 64 bits are
+// always fine. Documents are nested at most kMaxDepth deep, so that the
+// compiler's recursion limit is not hit first.
+class StaticParser {
+ public:
+  static constexpr size_t kMaxDepth = 64;
+
+  struct Size {
+    size_t nodes;
+    size_t chars;
+  };
+
+  // What a StaticJson needs to hold the text.
+  static constexpr Size count(std::string_view text) {
+    StaticParser parser(text, nullptr, 0, nullptr, 0);
+    parser.parse();
+    return Size{parser.nodeCount_, parser.charCount_};
+  }
+
+  // Without room for any node, the text is only checked and counted. Null
+  // checks would do, but GCC does not evaluate them at compile time in
+  // sanitized builds.
+  constexpr StaticParser(std::string_view text,
+                         StaticNode *nodes,
+                         size_t nodeCapacity,
+                         char *chars,
+                         size_t charCapacity)
+      : text_(text),
+        nodes_(nodes),
+        nodeCapacity_(nodeCapacity),
+        chars_(chars),
+        charCapacity_(charCapacity),
+        counting_(nodeCapacity == 0) {}
+
+  constexpr void parse() {
+    parseWhiteSpace();
+    parseValue(0);
+    parseWhiteSpace();
+    if (pos_ != text_.size()) error("Root not singular");
+  }
+
+ private:
+  std::string_view text_;
+  size_t pos_ = 0;
+  StaticNode *nodes_;
+  size_t nodeCapacity_;
+  size_t nodeCount_ = 0;
+  char *chars_;
+  size_t charCapacity_;
+  size_t charCount_ = 0;
+  const bool counting_;
+  // Stands in for every node while counting.
+  StaticNode scratch_;
+
+  [[noreturn]] static void error(const char *error) { staticJsonError(error); }
+
+  constexpr char peek() const {
+    return pos_ < text_.size() ? text_[pos_] : '\0';
+  }
+  constexpr StaticNode &node(size_t index) {
+    return counting_ ? scratch_ : nodes_[index];
+  }
+  constexpr void put(char ch) {
+    if (!counting_) {
+      if (charCount_ == charCapacity_) error("Document does not fit");
+      chars_[charCount_] = ch;
+    }
+    ++charCount_;
+  }
+
+  constexpr void parseWhiteSpace() {
+    while (peek() == ' ' || peek() == '\t' || peek() == '\n' || peek() == '\r')
+      ++pos_;
+  }
+
+  constexpr size_t parseValue(size_t depth) {
+    if (!counting_ && nodeCount_ == nodeCapacity_)
+      error("Document does not fit");
+    const size_t index = nodeCount_++;
+    node(index) = StaticNode();
+    switch (peek()) {
+      case 'n': {
+        parseLiteral("null");
+        break;
+      }
+      case 't': {
+        parseLiteral("true");
+        node(index).type = JsonType::kBool;
+        node(index).boolean = true;
+        break;
+      }
+      case 'f': {
+        parseLiteral("false");
+        node(index).type = JsonType::kBool;
+        break;
+      }
+      case '"': {
+        const auto string = parseString();
+        node(index).type = JsonType::kString;
+        node(index).offset = string.first;
+        node(index).length = string.second;
+        break;
+      }
+      case '[': {
+        parseArray(index, depth);
+        break;
+      }
+      case '{': {
+        parseObject(index, depth);
+        break;
+      }
+      case '\0': error("Expect value");
+      default: parseNumber(node(index));
+    }
+    node(index).end = nodeCount_;
+    return index;
+  }
+
+  constexpr void parseLiteral(std::string_view literal) {
+    if (text_.substr(pos_, literal.size()) != literal) error("Invalid value");
+    pos_ += literal.size();
+  }
+
+  constexpr void parseArray(size_t index, size_t depth) {
+    if (depth == kMaxDepth) error("Exceed maximum depth");
+    ++pos_;
+    parseWhiteSpace();
+    size_t size = 0;
+    if (peek() == ']') {
+      ++pos_;
+    } else {
+      for (;;) {
+        parseValue(depth + 1);
+        ++size;
+        parseWhiteSpace();
+        if (peek() == ']') {
+          ++pos_;
+          break;
+        }
+        if (peek() != ',') error("Missing closing bracket or comma");
+        ++pos_;
+        parseWhiteSpace();
+      }
+    }
+    node(index).type = JsonType::kArray;
+    node(index).size = size;
+  }
+
+  constexpr void parseObject(size_t index, size_t depth) {
+    if (depth == kMaxDepth) error("Exceed maximum depth");
+    ++pos_;
+    parseWhiteSpace();
+    size_t size = 0;
+    if (peek() == '}') {
+      ++pos_;
+    } else {
+      for (;;) {
+        if (peek() != '"') error("Missing key");
+        const auto key = parseString();
+        parseWhiteSpace();
+        if (peek() != ':') error("Missing colon");
+        ++pos_;
+        parseWhiteSpace();
+        const size_t child = parseValue(depth + 1);
+        ++size;
+        if (!counting_) {
+          nodes_[child].keyOffset = key.first;
+          nodes_[child].keyLength = key.second;
+          const std::string_view name(chars_ + key.first, key.second);
+          for (size_t other = index + 1; other != child;
+               other = nodes_[other].end) {
+            if (!nodes_[other].shadowed
+                && std::string_view(chars_ + nodes_[other].keyOffset,
+                                    nodes_[other].keyLength) == name) {
+              nodes_[other].shadowed = true;
+              --size;
+              break;
+            }
+          }
+        }
+        parseWhiteSpace();
+        if (peek() == '}') {
+          ++pos_;
+          break;
+        }
+        if (peek() != ',') error("Missing closing bracket or comma");
+        ++pos_;
+        parseWhiteSpace();
+      }
+    }
+    node(index).type = JsonType::kObject;
+    node(index).size = size;
+  }
+
+  // Returns the offset and length of the unescaped characters.
+  constexpr std::pair<size_t, size_t> parseString() {
+    ++pos_;
+    const size_t offset = charCount_;
+    for (;;) {
+      const char ch = peek();
+      if (ch == '"') {
+        ++pos_;
+        return {offset, charCount_ - offset};
+      }
+      if (ch == '\\') {
+        ++pos_;
+        switch (peek()) {
+          case '"': put('"');
+            break;
+          case '\\': put('\\');
+            break;
+          case '/': put('/');
+            break;
+          case 'b': put('\b');
+            break;
+          case 'f': put('\f');
+            break;
+          case 'n': put('\n');
+            break;
+          case 't': put('\t');
+            break;
+          case 'r': put('\r');
+            break;
+          case 'u': {
+            uint32_t codePoint = parse4hex();
+            if (0xd800 <= codePoint && codePoint <= 0xdbff) {
+              if (peek() != '\\') error("Invalid unicode surrogate");
+              ++pos_;
+              if (peek() != 'u') error("Invalid unicode surrogate");
+              const uint32_t low = parse4hex();
+              if (low < 0xdc00 || low > 0xdfff)
+                error("Invalid unicode surrogate");
+              codePoint = (((codePoint - 0xd800) << 10) | (low - 0xdc00))
+                  + 0x10000;
+            }
+            putUtf8(codePoint);
+            continue;
+          }
+          default: error("Invalid escape character");
+        }
+        ++pos_;
+      } else if (pos_ == text_.size()) {
+        error("Missing quotation mark");
+      } else if (static_cast<unsigned char>(ch) < 0x20) {
+        error("Invalid character");
+      } else {
+        put(ch);
+        ++pos_;
+      }
+    }
+  }
+
+  // Reads the four digits after the 'u' at |pos_| and moves past them.
+  constexpr uint32_t parse4hex() {
+    uint32_t u = 0;
+    for (int i = 0; i < 4; ++i) {
+      ++pos_;
+      const char ch = peek();
+      u <<= 4;
+      if ('0' <= ch && ch <= '9') u |= ch - '0';
+      else if ('A' <= ch && ch <= 'F') u |= ch - 'A' + 10;
+      else if ('a' <= ch && ch <= 'f') u |= ch - 'a' + 10;
+      else error("Invalid hex value");
+    }
+    ++pos_;
+    return u;
+  }
+
+  constexpr void putUtf8(uint32_t u) {
+    if (u < 0x80) {
+      put(static_cast<char>(u));
+    } else if (u < 0x800) {
+      put(static_cast<char>(0xc0 | (u >> 6)));
+      put(static_cast<char>(0x80 | (u & 0x3f)));
+    } else if (u < 0x10000) {
+      put(static_cast<char>(0xe0 | (u >> 12)));
+      put(static_cast<char>(0x80 | ((u >> 6) & 0x3f)));
+      put(static_cast<char>(0x80 | (u & 0x3f)));
+    } else {
+      put(static_cast<char>(0xf0 | (u >> 18)));
+      put(static_cast<char>(0x80 | ((u >> 12) & 0x3f)));
+      put(static_cast<char>(0x80 | ((u >> 6) & 0x3f)));
+      put(static_cast<char>(0x80 | (u & 0x3f)));
+    }
+  }
+
+  constexpr bool isDigit() const { return '0' <= peek() && peek() <= '9'; }
+
+  // A double is computed exactly from at most 2^53 times a power of ten up
+  // to 1e22: both fit a double exactly, so the one multiplication or
+  // division rounds the same way strtod() does. So does converting an
+  // integer of up to 19 digits without a power of ten.
+  constexpr void parseNumber(StaticNode &number) {
+    number.type = JsonType::kNumber;
+    const bool negative = peek() == '-';
+    if (negative) ++pos_;
+    const size_t integerBegin = pos_;
+    if (peek() == '0') {
+      ++pos_;
+    } else {
+      if (!isDigit()) error("Invalid value");
+      while (isDigit()) ++pos_;
+    }
+    const size_t integerEnd = pos_;
+    size_t fractionEnd = pos_;
+    if (peek() == '.') {
+      ++pos_;
+      if (!isDigit()) error("Invalid value");
+      while (isDigit()) ++pos_;
+      fractionEnd = pos_;
+    }
+    int64_t exponent = 0;
+    bool hasExponent = false;
+    if (peek() == 'e' || peek() == 'E') {
+      hasExponent = true;
+      ++pos_;
+      const bool negativeExponent = peek() == '-';
+      if (peek() == '+' || peek() == '-') ++pos_;
+      if (!isDigit()) error("Invalid value");
+      for (; isDigit(); ++pos_)
+        if (exponent < 100000) exponent = exponent * 10 + (peek() - '0');
+      if (negativeExponent) exponent = -exponent;
+    }
+
+    // Integers are kept exact if they fit. Only -0 needs a double for its
+    // sign.
+    uint64_t magnitude = 0;
+    bool fits = integerEnd - integerBegin <= 20;
+    for (size_t i = integerBegin; fits && i != integerEnd; ++i) {
+      const uint64_t digit = text_[i] - '0';
+      fits = magnitude <= (UINT64_MAX - digit) / 10;
+      magnitude = magnitude * 10 + digit;
+    }
+    if (fractionEnd == integerEnd && !hasExponent && fits
+        && !(negative && magnitude == 0)) {
+      constexpr auto kInt64Max = static_cast<uint64_t>(INT64_MAX);
+      if (negative && magnitude <= kInt64Max + 1) {
+        number.int64 = static_cast<int64_t>(0 - magnitude);
+        return;
+      }
+      if (!negative && magnitude <= kInt64Max) {
+        number.int64 = static_cast<int64_t>(magnitude);
+        return;
+      }
+      if (!negative) {
+        number.number = StaticNode::Number::kUint64;
+        number.uint64 = magnitude;
+        return;
+      }
+    }
+
+    // Up to 19 significant digits, times 10^exponent.
+    uint64_t significand = 0;
+    int digits = 0;
+    for (size_t i = integerBegin; i != fractionEnd; ++i) {
+      if (i == integerEnd) continue;
+      const bool fraction = i > integerEnd;
+      const int digit = text_[i] - '0';
+      if (digits == 19) {
+        if (digit) error("Number cannot be read exactly at compile time");
+        if (!fraction) ++exponent;
+        continue;
+      }
+      if (fraction) --exponent;
+      if (significand || digit) {
+        significand = significand * 10 + digit;
+        ++digits;
+      }
+    }
+    while (significand && significand % 10 == 0) {
+      significand /= 10;
+      ++exponent;
+    }
+    constexpr uint64_t kExact = uint64_t(1) << 53;
+    while (significand && exponent > 22 && significand <= kExact / 10) {
+      significand *= 10;
+      --exponent;
+    }
+    double value = 0;
+    if (significand) {
+      if ((exponent && significand > kExact) || exponent > 22
+          || exponent < -22)
+        error("Number cannot be read exactly at compile time");
+      double power = 1;
+      for (int64_t i = exponent < 0 ? -exponent : exponent; i; --i)
+        power *= 10;
+      value = static_cast<double>(significand);
+      value = exponent < 0 ? value / power : value * power;
+    }
+    number.number = StaticNode::Number::kDouble;
+    number.real = negative ? -value : value;
+  }
+};
+
+// A document parsed at compile time, see LIGHTJSON_STATIC_JSON, which works
+// out how many nodes and characters it takes.
+template<size_t Nodes, size_t Chars>
+class StaticJson {
+ public:
+  constexpr explicit StaticJson(std::string_view text) {
+    StaticParser(text, nodes_, Nodes, chars_, Chars).parse();
+  }
+
+  constexpr StaticJsonView root() const {
+    return StaticJsonView(nodes_, chars_, 0);
+  }
+  constexpr operator StaticJsonView() const { return root(); }
+  constexpr StaticJsonView operator[](size_t i) const { return root()[i]; }
+  constexpr StaticJsonView operator[](std::string_view key) const {
+    return root()[key];
+  }
+
+ private:
+  StaticNode nodes_[Nodes] = {};
+  // Room for one character even in documents without strings.
+  char chars_[Chars ? Chars : 1] = {};
+};
+
+} // namespace
+
+#endif //LIGHTJSON_STATICJSON_H
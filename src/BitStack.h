@@ -0,0 +1,47 @@
+#ifndef LIGHTJSON_BITSTACK_H
+#define LIGHTJSON_BITSTACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lightjson {
+
+// A stack of bits. The first 256 live inside the object, so walking a
+// document nested less deeply than that never allocates.
+class BitStack {
+ public:
+  void push(bool bit) {
+    const size_t word = size_ / 64;
+    const uint64_t mask = uint64_t(1) << (size_ % 64);
+    if (word >= kInlineWords && word - kInlineWords == spill_.size())
+      spill_.push_back(0);
+    uint64_t &bits = wordAt(word);
+    bits = bit ? bits | mask : bits & ~mask;
+    ++size_;
+  }
+  void pop() { --size_; }
+  bool top() const {
+    const size_t word = (size_ - 1) / 64;
+    const uint64_t bits =
+        word < kInlineWords ? inline_[word] : spill_[word - kInlineWords];
+    return (bits >> ((size_ - 1) % 64)) & 1;
+  }
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+ private:
+  static constexpr size_t kInlineWords = 4;
+
+  uint64_t &wordAt(size_t word) {
+    return word < kInlineWords ? inline_[word] : spill_[word - kInlineWords];
+  }
+
+  uint64_t inline_[kInlineWords] = {};
+  std::vector<uint64_t> spill_;
+  size_t size_ = 0;
+};
+
+} // namespace
+
+#endif //LIGHTJSON_BITSTACK_H
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "Codec.h"
+#include "JsonException.h"
+
+#ifdef LIGHTJSON_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LIGHTJSON_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace ::lightjson;
+
+namespace {
+
+class IdentityCodec : public Codec {
+ public:
+  size_t decompress(const char *&in,
+                    const char *end,
+                    char *out,
+                    size_t capacity) override {
+    const size_t size = std::min<size_t>(end - in, capacity);
+    memcpy(out, in, size);
+    in += size;
+    return size;
+  }
+};
+
+#ifdef LIGHTJSON_WITH_ZLIB
+// gzip or zlib, told apart by inflate() itself. Concatenated gzip members,
+// as written by e.g. `cat a.gz b.gz`, are read one after the other.
+class ZlibCodec : public Codec {
+ public:
+  ZlibCodec() {
+    memset(&stream_, 0, sizeof(stream_));
+    // 32 on top of the window bits accepts both headers.
+    if (inflateInit2(&stream_, 15 + 32) != Z_OK)
+      throw JsonException("Cannot initialize zlib");
+  }
+  ~ZlibCodec() override { inflateEnd(&stream_); }
+
+  size_t decompress(const char *&in,
+                    const char *end,
+                    char *out,
+                    size_t capacity) override {
+    stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+    stream_.avail_in = static_cast<uInt>(std::min<size_t>(end - in, UINT_MAX));
+    stream_.next_out = reinterpret_cast<Bytef *>(out);
+    stream_.avail_out = static_cast<uInt>(std::min<size_t>(capacity, UINT_MAX));
+    const uInt available = stream_.avail_out;
+    while (stream_.avail_out) {
+      if (ended_) {
+        if (!stream_.avail_in) break;
+        inflateReset(&stream_);
+        ended_ = false;
+      }
+      const int ret = inflate(&stream_, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+        ended_ = true;
+        continue;
+      }
+      if (ret == Z_BUF_ERROR) break;
+      if (ret != Z_OK) throw JsonException("Invalid compressed data");
+      if (!stream_.avail_in) break;
+    }
+    in = reinterpret_cast<const char *>(stream_.next_in);
+    return available - stream_.avail_out;
+  }
+
+  void finish() override {
+    if (!ended_) throw JsonException("Truncated compressed data");
+  }
+
+ private:
+  z_stream stream_;
+  bool ended_ = false;
+};
+#endif
+
+#ifdef LIGHTJSON_WITH_ZSTD
+class ZstdCodec : public Codec {
+ public:
+  ZstdCodec() : stream_(ZSTD_createDStream()) {
+    if (!stream_) throw JsonException("Cannot initialize zstd");
+  }
+  ~ZstdCodec() override { ZSTD_freeDStream(stream_); }
+
+  size_t decompress(const char *&in,
+                    const char *end,
+                    char *out,
+                    size_t capacity) override {
+    ZSTD_inBuffer input{in, static_cast<size_t>(end - in), 0};
+    ZSTD_outBuffer output{out, capacity, 0};
+    while (output.pos != output.size) {
+      const size_t ret = ZSTD_decompressStream(stream_, &output, &input);
+      if (ZSTD_isError(ret)) throw JsonException("Invalid compressed data");
+      // 0 at the end of a frame, which may be followed by another one.
+      ended_ = ret == 0;
+      if (input.pos == input.size && (ended_ || output.pos != output.size))
+        break;
+    }
+    in += input.pos;
+    return output.pos;
+  }
+
+  void finish() override {
+    if (!ended_) throw JsonException("Truncated compressed data");
+  }
+
+ private:
+  ZSTD_DStream *stream_;
+  bool ended_ = false;
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<Codec> lightjson::makeCodec(Compression compression,
+                                            const char *head,
+                                            size_t size) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(head);
+  if (compression == Compression::kAuto) {
+    compression = Compression::kNone;
+    // Neither magic number can start JSON text. A zlib header can, e.g.
+    // "80", so zlib streams are only read as kGzip.
+    if (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+      compression = Compression::kGzip;
+    } else if (size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xb5
+        && bytes[2] == 0x2f && bytes[3] == 0xfd) {
+      compression = Compression::kZstd;
+    }
+  }
+  switch (compression) {
+    case Compression::kGzip:
+#ifdef LIGHTJSON_WITH_ZLIB
+      return std::unique_ptr<Codec>(new ZlibCodec());
+#else
+      throw JsonException("Built without gzip support");
+#endif
+    case Compression::kZstd:
+#ifdef LIGHTJSON_WITH_ZSTD
+      return std::unique_ptr<Codec>(new ZstdCodec());
+#else
+      throw JsonException("Built without zstd support");
+#endif
+    default: return std::unique_ptr<Codec>(new IdentityCodec());
+  }
+}
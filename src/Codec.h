@@ -0,0 +1,36 @@
+#ifndef LIGHTJSON_CODEC_H
+#define LIGHTJSON_CODEC_H
+
+#include <cstddef>
+#include <memory>
+#include "../include/JsonStream.h"
+
+namespace lightjson {
+
+// Decompresses a stream one block of input at a time, see JsonStream.
+class Codec {
+ public:
+  virtual ~Codec() = default;
+
+  // Decompresses from [*in, end) into [out, out + capacity), moves *in past
+  // the input used and returns the number of bytes written. Stops when the
+  // input runs out or the output is full; in the latter case, more output
+  // may be pending even if all input was used. Throws on corrupt data.
+  virtual size_t decompress(const char *&in,
+                            const char *end,
+                            char *out,
+                            size_t capacity) = 0;
+  // Throws if the input ended in the middle of compressed data.
+  virtual void finish() {}
+};
+
+// The codec for |compression|. kAuto tells gzip and zstd streams apart by
+// the first bytes, |head|, and takes anything else to be uncompressed.
+// Throws if the library needed was not built in.
+std::unique_ptr<Codec> makeCodec(Compression compression,
+                                 const char *head,
+                                 size_t size);
+
+} // namespace
+
+#endif //LIGHTJSON_CODEC_H
@@ -0,0 +1,292 @@
+#include <cmath>
+#include <cstring>
+#include "../include/Columnar.h"
+#include "JsonValue.h"
+#include "Number.h"
+#include "Parser.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+// Number of rows written to |column| so far.
+size_t length(const Column &column) {
+  switch (column.type) {
+    case ColumnType::kDouble: return column.doubles.size();
+    case ColumnType::kInt64: return column.ints.size();
+    case ColumnType::kBool: return column.bools.size();
+    default: return column.offsets.size() - 1;
+  }
+}
+
+const char *typeName(ColumnType type) {
+  switch (type) {
+    case ColumnType::kDouble: return "number";
+    case ColumnType::kInt64: return "64-bit integer";
+    case ColumnType::kBool: return "bool";
+    default: return "string";
+  }
+}
+
+} // namespace
+
+void Columns::add(std::string name, ColumnType type) {
+  auto it = index_.find(name);
+  if (it != index_.end()) {
+    columns_[it->second].type = type;
+    return;
+  }
+  index_.emplace(name, columns_.size());
+  columns_.emplace_back(std::move(name), type);
+}
+
+const Column *Columns::find(const std::string &name) const {
+  auto it = index_.find(name);
+  return it == index_.end() ? nullptr : &columns_[it->second];
+}
+
+bool Columns::extract(const std::string &text, std::string &error) {
+  Parser parser(text);
+  return extract(parser, error);
+}
+
+bool Columns::extract(const char *text, std::string &error) {
+  Parser parser(text);
+  return extract(parser, error);
+}
+
+bool Columns::extract(Parser &parser, std::string &error) {
+  clear();
+  try {
+    parser.parseColumns(*this);
+    return true;
+  } catch (JsonException &e) {
+    error = e.what();
+    clear();
+    return false;
+  }
+}
+
+bool Columns::extract(const Json &records, std::string &error) {
+  clear();
+  try {
+    if (!records.isArray()) throw JsonException("Expect array of objects");
+    for (const auto &record: records.value().arrayItems()) {
+      if (!record.isObject()) throw JsonException("Expect array of objects");
+      beginRow();
+      for (auto &column: columns_) {
+        const Json *json = record.find(column.name);
+        if (!json || json->isNull()) {
+          appendNull(column);
+          continue;
+        }
+        const auto &value = json->value();
+        bool matches = true;
+        switch (column.type) {
+          case ColumnType::kDouble: {
+            matches = json->isNumber();
+            if (matches) appendDouble(column, value.toDouble());
+            break;
+          }
+          case ColumnType::kInt64: {
+            matches = json->isNumber();
+            if (matches) appendInt64(column, json->toInt64());
+            break;
+          }
+          case ColumnType::kBool: {
+            matches = json->isBool();
+            if (matches) appendBool(column, value.toBool());
+            break;
+          }
+          case ColumnType::kString: {
+            matches = json->isString();
+            if (!matches) break;
+            column.chars += value.stringValue();
+            column.offsets.push_back(column.chars.size());
+            setValid(column);
+            break;
+          }
+        }
+        if (!matches)
+          throw JsonException(std::string("Expect ") + typeName(column.type)
+                                  + " for " + column.name);
+      }
+      endRow();
+    }
+    return true;
+  } catch (JsonException &e) {
+    error = e.what();
+    clear();
+    return false;
+  }
+}
+
+void Columns::clear() {
+  rows_ = 0;
+  for (auto &column: columns_) {
+    column.doubles.clear();
+    column.ints.clear();
+    column.bools.clear();
+    column.chars.clear();
+    column.offsets.assign(1, 0);
+    column.validity.clear();
+    column.nullCount = 0;
+  }
+}
+
+void Columns::beginRow() {
+  if (rows_ % 64 == 0)
+    for (auto &column: columns_) column.validity.push_back(0);
+}
+
+void Columns::endRow() {
+  for (auto &column: columns_)
+    if (length(column) == rows_) appendNull(column);
+  ++rows_;
+}
+
+void Columns::rewind(Column &column) {
+  if (length(column) == rows_) return;
+  if (column.isNull(rows_)) --column.nullCount;
+  column.validity[rows_ / 64] &= ~(uint64_t{1} << (rows_ % 64));
+  switch (column.type) {
+    case ColumnType::kDouble: column.doubles.pop_back(); break;
+    case ColumnType::kInt64: column.ints.pop_back(); break;
+    case ColumnType::kBool: column.bools.pop_back(); break;
+    case ColumnType::kString: {
+      column.offsets.pop_back();
+      column.chars.resize(column.offsets.back());
+      break;
+    }
+  }
+}
+
+void Columns::appendNull(Column &column) {
+  rewind(column);
+  switch (column.type) {
+    case ColumnType::kDouble: column.doubles.push_back(0); break;
+    case ColumnType::kInt64: column.ints.push_back(0); break;
+    case ColumnType::kBool: column.bools.push_back(0); break;
+    case ColumnType::kString: column.offsets.push_back(column.chars.size());
+  }
+  ++column.nullCount;
+}
+
+void Columns::appendDouble(Column &column, double value) {
+  rewind(column);
+  column.doubles.push_back(value);
+  setValid(column);
+}
+
+void Columns::appendInt64(Column &column, int64_t value) {
+  rewind(column);
+  column.ints.push_back(value);
+  setValid(column);
+}
+
+void Columns::appendBool(Column &column, bool value) {
+  rewind(column);
+  column.bools.push_back(value);
+  setValid(column);
+}
+
+void Columns::setValid(Column &column) {
+  column.validity[rows_ / 64] |= uint64_t{1} << (rows_ % 64);
+}
+
+// Reads the record array the way parseValue() would, except that the values
+// of columns go straight into them and everything else is skipped.
+void Parser::parseColumns(Columns &columns) {
+  std::string &key = ownScratch_;
+  parseWhiteSpace();
+  if (*curr_ != '[') error("Expect array of objects");
+  curr_++;
+  parseWhiteSpace();
+  if (*curr_ == ']') {
+    curr_++;
+  } else {
+    for (;;) {
+      if (*curr_ != '{') error("Expect array of objects");
+      curr_++;
+      columns.beginRow();
+      parseWhiteSpace();
+      if (*curr_ != '}') {
+        for (;;) {
+          parseKey(key);
+          auto it = columns.index_.find(key);
+          if (it == columns.index_.end()) skipValue();
+          else parseCell(columns, columns.columns_[it->second]);
+          parseWhiteSpace();
+          if (*curr_ != ',') break;
+          curr_++;
+          parseWhiteSpace();
+        }
+        if (*curr_ != '}') error("Missing closing bracket or comma");
+      }
+      curr_++;
+      columns.endRow();
+      parseWhiteSpace();
+      if (*curr_ != ',') break;
+      curr_++;
+      parseWhiteSpace();
+    }
+    if (*curr_ != ']') error("Missing closing bracket or comma");
+    curr_++;
+  }
+  parseWhiteSpace();
+  if (*curr_) error("Root not singular");
+}
+
+void Parser::parseCell(Columns &columns, Column &column) {
+  const char ch = *curr_;
+  if (ch == 'n') {
+    if (strncmp(curr_, "null", 4) != 0) error("Invalid value");
+    curr_ += 4;
+    columns.appendNull(column);
+    return;
+  }
+  switch (column.type) {
+    case ColumnType::kDouble: {
+      if (ch != '-' && !('0' <= ch && ch <= '9')) break;
+      const char *start = curr_;
+      scanNumber();
+      const double val = strtod(start, nullptr);
+      if (std::abs(val) == HUGE_VAL) error("Number out of bound");
+      columns.appendDouble(column, val);
+      return;
+    }
+    case ColumnType::kInt64: {
+      if (ch != '-' && !('0' <= ch && ch <= '9')) break;
+      const char *start = curr_;
+      scanNumber();
+      int64_t val;
+      if (!toInt64(canonicalNumber(start, curr_), val))
+        error("Number is not a 64-bit integer");
+      columns.appendInt64(column, val);
+      return;
+    }
+    case ColumnType::kBool: {
+      if (strncmp(curr_, "true", 4) == 0) {
+        curr_ += 4;
+        columns.appendBool(column, true);
+        return;
+      }
+      if (strncmp(curr_, "false", 5) == 0) {
+        curr_ += 5;
+        columns.appendBool(column, false);
+        return;
+      }
+      break;
+    }
+    case ColumnType::kString: {
+      if (ch != '"') break;
+      columns.rewind(column);
+      // Decoded straight into the column.
+      parseRawString(column.chars);
+      column.offsets.push_back(column.chars.size());
+      columns.setValid(column);
+      return;
+    }
+  }
+  error(std::string("Expect ") + typeName(column.type) + " for " + column.name);
+}
@@ -0,0 +1,263 @@
+// Ryu, from Ulf Adams, "Ryu: Fast Float-to-String Conversion" (PLDI 2018),
+// following the layout of the reference implementation's d2s.c. The output
+// is the shortest decimal that reads back as the same double, and of those
+// the one closest to it.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "Dtoa.h"
+#include "DtoaTables.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+constexpr int kMantissaBits = 52;
+constexpr int kExponentBits = 11;
+constexpr int kBias = 1023;
+
+// ceil(log2(5^e)) for e > 0, 1 for e = 0.
+int pow5Bits(int e) { return static_cast<int>((e * 1217359u) >> 19u) + 1; }
+// floor(log10(2^e)) and floor(log10(5^e)), for 0 <= e <= 1650.
+int log10Pow2(int e) { return static_cast<int>((e * 78913u) >> 18u); }
+int log10Pow5(int e) { return static_cast<int>((e * 732923u) >> 20u); }
+
+bool multipleOfPowerOf5(uint64_t value, int p) {
+  int count = 0;
+  while (value % 5 == 0) {
+    value /= 5;
+    ++count;
+  }
+  return count >= p;
+}
+
+bool multipleOfPowerOf2(uint64_t value, int p) {
+  return (value & ((uint64_t{1} << p) - 1)) == 0;
+}
+
+// (m * mul) >> j, where mul is a 125 bit table entry and j >= 64.
+uint64_t mulShift(uint64_t m, const uint64_t *mul, int j) {
+  using uint128 = unsigned __int128;
+  const uint128 low = static_cast<uint128>(m) * mul[0];
+  const uint128 high = static_cast<uint128>(m) * mul[1];
+  return static_cast<uint64_t>(((low >> 64u) + high) >> (j - 64));
+}
+
+// A double as output * 10^exponent, with as few digits in output as
+// possible.
+struct Decimal {
+  uint64_t output;
+  int exponent;
+};
+
+Decimal shortest(uint64_t ieeeMantissa, int ieeeExponent) {
+  // The value is m2 * 2^e2. Two more bits make room for the halfway points
+  // to the neighbours.
+  int e2;
+  uint64_t m2;
+  if (ieeeExponent == 0) {
+    e2 = 1 - kBias - kMantissaBits - 2;
+    m2 = ieeeMantissa;
+  } else {
+    e2 = ieeeExponent - kBias - kMantissaBits - 2;
+    m2 = (uint64_t{1} << kMantissaBits) | ieeeMantissa;
+  }
+  // Round half to even: the halfway points are accepted for even m2.
+  const bool acceptBounds = (m2 & 1u) == 0;
+  const uint64_t mv = 4 * m2;
+  // The gap below a power of two is half the gap above it.
+  const uint32_t mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+
+  // Scale the value and the halfway points above (vp) and below (vm) it to
+  // decimal, keeping track of whether the dropped digits were all zeros.
+  uint64_t vr, vp, vm;
+  int e10;
+  bool vmIsTrailingZeros = false;
+  bool vrIsTrailingZeros = false;
+  if (e2 >= 0) {
+    const int q = log10Pow2(e2) - (e2 > 3);
+    e10 = q;
+    const int k = kPow5InvBitCount + pow5Bits(q) - 1;
+    const int i = -e2 + q + k;
+    const uint64_t *mul = kPow5InvSplit[q];
+    vr = mulShift(4 * m2, mul, i);
+    vp = mulShift(4 * m2 + 2, mul, i);
+    vm = mulShift(4 * m2 - 1 - mmShift, mul, i);
+    if (q <= 21) {
+      // Only one of mv, mv - 1 - mmShift and mv + 2 can be a multiple of 5.
+      if (mv % 5 == 0) vrIsTrailingZeros = multipleOfPowerOf5(mv, q);
+      else if (acceptBounds)
+        vmIsTrailingZeros = multipleOfPowerOf5(mv - 1 - mmShift, q);
+      else vp -= multipleOfPowerOf5(mv + 2, q);
+    }
+  } else {
+    const int q = log10Pow5(-e2) - (-e2 > 1);
+    e10 = q + e2;
+    const int i = -e2 - q;
+    const int k = pow5Bits(i) - kPow5BitCount;
+    const int j = q - k;
+    const uint64_t *mul = kPow5Split[i];
+    vr = mulShift(4 * m2, mul, j);
+    vp = mulShift(4 * m2 + 2, mul, j);
+    vm = mulShift(4 * m2 - 1 - mmShift, mul, j);
+    if (q <= 1) {
+      // mv has at least q trailing zero bits, so vr is exact.
+      vrIsTrailingZeros = true;
+      if (acceptBounds) vmIsTrailingZeros = mmShift == 1;
+      else --vp;
+    } else if (q < 63) {
+      vrIsTrailingZeros = multipleOfPowerOf2(mv, q);
+    }
+  }
+
+  // Drop digits while vp and vm still differ in the remaining ones.
+  int removed = 0;
+  uint64_t lastRemovedDigit = 0;
+  uint64_t output;
+  if (vmIsTrailingZeros || vrIsTrailingZeros) {
+    for (;;) {
+      if (vp / 10 <= vm / 10) break;
+      vmIsTrailingZeros &= vm % 10 == 0;
+      vrIsTrailingZeros &= lastRemovedDigit == 0;
+      lastRemovedDigit = vr % 10;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    if (vmIsTrailingZeros) {
+      while (vm % 10 == 0) {
+        vrIsTrailingZeros &= lastRemovedDigit == 0;
+        lastRemovedDigit = vr % 10;
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        ++removed;
+      }
+    }
+    // Exactly halfway: round to even.
+    if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0)
+      lastRemovedDigit = 4;
+    output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros))
+        || lastRemovedDigit >= 5);
+  } else {
+    // The common case, where no exact halfway case can come up.
+    bool roundUp = false;
+    for (;;) {
+      if (vp / 10 <= vm / 10) break;
+      roundUp = vr % 10 >= 5;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    output = vr + (vr == vm || roundUp);
+  }
+  return {output, e10 + removed};
+}
+
+char *appendExponent(char *buf, int e) {
+  *buf++ = e < 0 ? '-' : '+';
+  auto k = static_cast<uint32_t>(e < 0 ? -e : e);
+  if (k >= 100) {
+    *buf++ = static_cast<char>('0' + k / 100);
+    k %= 100;
+  }
+  // At least two digits, like printf.
+  *buf++ = static_cast<char>('0' + k / 10);
+  *buf++ = static_cast<char>('0' + k % 10);
+  return buf;
+}
+
+// Writes the decimal digits of |n| and returns how many there are.
+int writeDigits(char *buf, uint64_t n) {
+  char digits[20];
+  int size = 0;
+  do {
+    digits[size++] = static_cast<char>('0' + n % 10);
+    n /= 10;
+  } while (n);
+  for (int i = 0; i != size; ++i) buf[i] = digits[size - 1 - i];
+  return size;
+}
+
+// Lays out the |size| digits at |buf| times 10^exponent.
+char *formatDigits(char *buf, int size, int exponent) {
+  constexpr int kMinExponent = -4;
+  constexpr int kMaxExponent = 15;
+  // The position of the decimal point relative to the first digit.
+  const int point = size + exponent;
+  if (size <= point && point <= kMaxExponent) {
+    // digits000
+    std::memset(buf + size, '0', static_cast<size_t>(point - size));
+    return buf + point;
+  }
+  if (0 < point && point <= kMaxExponent) {
+    // dig.its
+    std::memmove(buf + point + 1, buf + point,
+                 static_cast<size_t>(size - point));
+    buf[point] = '.';
+    return buf + size + 1;
+  }
+  if (kMinExponent < point && point <= 0) {
+    // 0.000digits
+    std::memmove(buf + 2 - point, buf, static_cast<size_t>(size));
+    buf[0] = '0';
+    buf[1] = '.';
+    std::memset(buf + 2, '0', static_cast<size_t>(-point));
+    return buf + 2 - point + size;
+  }
+  // d.igitse+123
+  if (size > 1) {
+    std::memmove(buf + 2, buf + 1, static_cast<size_t>(size - 1));
+    buf[1] = '.';
+    buf += size + 1;
+  } else {
+    buf += 1;
+  }
+  *buf++ = 'e';
+  return appendExponent(buf, point - 1);
+}
+
+} // namespace
+
+char *lightjson::formatDouble(char *buf, double value) {
+  if (std::isnan(value)) {
+    std::memcpy(buf, "nan", 3);
+    return buf + 3;
+  }
+  if (std::signbit(value)) {
+    *buf++ = '-';
+    value = -value;
+  }
+  if (std::isinf(value)) {
+    std::memcpy(buf, "inf", 3);
+    return buf + 3;
+  }
+  // Integers are common and need no digit generation.
+  if (value < 1e15) {
+    const auto n = static_cast<uint64_t>(value);
+    if (static_cast<double>(n) == value) return buf + writeDigits(buf, n);
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const Decimal d = shortest(bits & ((uint64_t{1} << kMantissaBits) - 1),
+                             static_cast<int>(bits >> kMantissaBits)
+                                 & ((1 << kExponentBits) - 1));
+  return formatDigits(buf, writeDigits(buf, d.output), d.exponent);
+}
+
+char *lightjson::formatInteger(char *buf, int64_t value) {
+  // Negate in unsigned arithmetic, so that INT64_MIN does not overflow.
+  auto n = static_cast<uint64_t>(value);
+  if (value < 0) {
+    *buf++ = '-';
+    n = 0 - n;
+  }
+  return buf + writeDigits(buf, n);
+}
+
+char *lightjson::formatInteger(char *buf, uint64_t value) {
+  return buf + writeDigits(buf, value);
+}
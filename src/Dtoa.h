@@ -0,0 +1,25 @@
+#ifndef LIGHTJSON_DTOA_H
+#define LIGHTJSON_DTOA_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lightjson {
+
+// Buffer size formatDouble() needs.
+constexpr size_t kDoubleBufferSize = 32;
+
+// Writes the shortest decimal that reads back as exactly |value| (Ryu, see
+// Dtoa.cpp) and returns the end of the output. Integral values below 10^15
+// are written without a fraction or exponent, other values switch to
+// exponential notation outside [1e-4, 1e15). Non-finite values are written as
+// "nan", "inf" and "-inf". Never depends on the locale.
+char *formatDouble(char *buf, double value);
+// Writes |value| in decimal and returns the end of the output. Needs at most
+// 20 characters, kDoubleBufferSize is enough.
+char *formatInteger(char *buf, int64_t value);
+char *formatInteger(char *buf, uint64_t value);
+
+} // namespace
+
+#endif //LIGHTJSON_DTOA_H
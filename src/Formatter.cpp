@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "Formatter.h"
+#include "Grammar.h"
+#include "StringScan.h"
+
+using namespace ::lightjson;
+
+// The document is walked iteratively: the outer loop consumes one value, the
+// inner loop consumes whatever may follow a value (a comma, or the closing
+// brackets of the containers it completes).
+void Formatter::format() {
+  skipWhiteSpace();
+  for (;;) {
+    switch (*curr_) {
+      case 'n': {
+        formatLiteral("null", 4);
+        break;
+      }
+      case 't': {
+        formatLiteral("true", 4);
+        break;
+      }
+      case 'f': {
+        formatLiteral("false", 5);
+        break;
+      }
+      case '\"': {
+        formatString();
+        break;
+      }
+      case '[':
+      case '{': {
+        const bool isObject = *curr_ == '{';
+        if (nesting_.size() == maxDepth_) error("Exceed maximum depth");
+        emit(*curr_++);
+        skipWhiteSpace();
+        if (*curr_ == (isObject ? '}' : ']')) {
+          emit(*curr_++);
+          break;
+        }
+        nesting_.push(isObject);
+        newLine();
+        if (isObject) formatKey();
+        continue;
+      }
+      case '\0': error("Expect value");
+      default: formatNumber();
+    }
+    for (;;) {
+      skipWhiteSpace();
+      if (nesting_.empty()) {
+        if (*curr_) error("Root not singular");
+        return;
+      }
+      const bool isObject = nesting_.top();
+      if (*curr_ == ',') {
+        emit(*curr_++);
+        newLine();
+        skipWhiteSpace();
+        if (isObject) formatKey();
+        break;
+      }
+      if (*curr_ != (isObject ? '}' : ']'))
+        error("Missing closing bracket or comma");
+      nesting_.pop();
+      newLine();
+      emit(*curr_++);
+    }
+  }
+}
+
+void Formatter::formatLiteral(const char *literal, size_t size) {
+  if (strncmp(curr_, literal, size) != 0) error("Invalid value");
+  emit(literal, literal + size);
+  curr_ += size;
+}
+
+void Formatter::formatNumber() {
+  const char *p = curr_;
+  const char *digitsEnd;
+  if (!scanNumber(p, digitsEnd)) {
+    curr_ = p;
+    error("Invalid value");
+  }
+  // Parser rejects what overflows a double, so validating must too. Only an
+  // exponent or a long integer part can, so strtod() is spared on the rest.
+  const bool exponent = std::any_of(digitsEnd, p, [](char ch) {
+    return ch == 'e' || ch == 'E';
+  });
+  if (!out_ && (exponent || digitsEnd - curr_ > 300)
+      && std::abs(strtod(curr_, nullptr)) == HUGE_VAL) {
+    curr_ = p;
+    error("Number out of bound");
+  }
+  emit(curr_, p);
+  curr_ = p;
+}
+
+// Strings are copied verbatim, escapes included. They only need to be checked.
+void Formatter::formatString() {
+  const char *p = curr_ + 1;
+  for (;;) {
+    p = skipUnescaped(p, end_);
+    switch (*p) {
+      case '\"': {
+        emit(curr_, ++p);
+        curr_ = p;
+        return;
+      }
+      case '\\':
+        switch (*++p) {
+          case '\"':
+          case '\\':
+          case '/':
+          case 'b':
+          case 'f':
+          case 'n':
+          case 't':
+          case 'r': break;
+          case 'u': {
+            int highSurrogate = parse4hex(&p);
+            if (0xd800 <= highSurrogate && highSurrogate <= 0xdbff) {
+              if (*++p != '\\') error("Invalid unicode surrogate");
+              if (*++p != 'u') error("Invalid unicode surrogate");
+              int lowSurrogate = parse4hex(&p);
+              if (lowSurrogate < 0xdc00 || lowSurrogate > 0xdfff)
+                error("Invalid unicode surrogate");
+            }
+            break;
+          }
+          default: error("Invalid escape character");
+        }
+        ++p;
+        break;
+      case '\0': error("Missing quotation mark");
+      default: error("Invalid character");
+    }
+  }
+}
+
+void Formatter::formatKey() {
+  if (*curr_ != '"') error("Missing key");
+  formatString();
+  skipWhiteSpace();
+  if (*curr_++ != ':')
+    error("Missing colon");
+  if (indent_ < 0) emit(':');
+  else emit(": ", ": " + 2);
+  skipWhiteSpace();
+}
+
+void Formatter::newLine() {
+  if (indent_ < 0 || !out_) return;
+  *out_ += '\n';
+  out_->append(nesting_.size() * indent_, ' ');
+}
+
+void Formatter::skipWhiteSpace() {
+  while (*curr_ == ' ' || *curr_ == '\t' || *curr_ == '\n' || *curr_ == '\r')
+    curr_++;
+}
+
+int Formatter::parse4hex(const char **p) {
+  int u;
+  if (!lightjson::parse4hex(*p, u)) error("Invalid hex value");
+  return u;
+}
@@ -0,0 +1,70 @@
+#ifndef LIGHTJSON_FORMATTER_H
+#define LIGHTJSON_FORMATTER_H
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include "BitStack.h"
+#include "JsonException.h"
+
+namespace lightjson {
+
+// Re-emits JSON text without building a tree. The input is validated with the
+// same grammar as Parser while it is copied, so the output is only meaningful
+// if format() returns without throwing.
+class Formatter {
+ public:
+  // A negative |indent| produces minified output, otherwise every member is
+  // put on its own line, indented by |indent| spaces per nesting level.
+  Formatter(const std::string &data, std::string &out, int indent)
+      : curr_(data.c_str()),
+        end_(data.c_str() + data.size()),
+        out_(&out),
+        indent_(indent),
+        maxDepth_(std::numeric_limits<size_t>::max()) {}
+  // Validates only. Nothing is written and nothing is allocated, unless the
+  // document nests deeper than BitStack keeps inline. Like Parser, rejects
+  // documents nested deeper than |maxDepth|, and numbers a double can't hold.
+  Formatter(const std::string &data, size_t maxDepth)
+      : curr_(data.c_str()),
+        end_(data.c_str() + data.size()),
+        out_(nullptr),
+        indent_(-1),
+        maxDepth_(maxDepth) {}
+  // Make the Formatter uncopiable.
+  Formatter(const Formatter &) = delete;
+  Formatter &operator=(const Formatter &) = delete;
+
+  void format();
+
+ private:
+  const char *curr_;
+  const char *const end_;
+  std::string *const out_;
+  const int indent_;
+  const size_t maxDepth_;
+  // One bit per open container, set for objects.
+  BitStack nesting_;
+
+  void formatLiteral(const char *, size_t);
+  void formatNumber();
+  void formatString();
+  void formatKey();
+
+  void emit(char ch) {
+    if (out_) *out_ += ch;
+  }
+  void emit(const char *begin, const char *end) {
+    if (out_) out_->append(begin, end);
+  }
+  void newLine();
+  void skipWhiteSpace();
+  int parse4hex(const char **);
+  [[noreturn]] void error(const std::string &msg) const {
+    throw JsonException(msg + ": " + curr_);
+  }
+};
+
+} // namespace
+
+#endif //LIGHTJSON_FORMATTER_H
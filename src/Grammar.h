@@ -0,0 +1,56 @@
+#ifndef LIGHTJSON_GRAMMAR_H
+#define LIGHTJSON_GRAMMAR_H
+
+namespace lightjson {
+
+// The parts of the JSON grammar that both Parser and Formatter check. They
+// stop at the first character that does not fit and return false, and the
+// caller reports the error the way it reports every other one.
+
+constexpr bool isDigit(const char *ch) { return '0' <= *ch && *ch <= '9'; }
+constexpr bool isDigit1to9(const char *ch) { return '1' <= *ch && *ch <= '9'; }
+
+// Moves |p| past the number at |p|, and sets |digitsEnd| to where its integer
+// part ends.
+inline bool scanNumber(const char *&p, const char *&digitsEnd) {
+  if (*p == '-') ++p;
+  // if 0 leads, the number must have a decimal component.
+  if (*p == '0') ++p;
+  else {
+    // else, leading digit cannot be 0 (or anything else).
+    if (!isDigit1to9(p)) return false;
+    while (isDigit(++p));
+  }
+  digitsEnd = p;
+  if (*p == '.') {
+    if (!isDigit(++p)) return false;
+    while (isDigit(++p));
+  }
+  if (*p == 'e' || *p == 'E') {
+    ++p;
+    // +- sign after exponent is optional.
+    if (*p == '+' || *p == '-') ++p;
+    if (!isDigit(p)) return false;
+    while (isDigit(++p));
+  }
+  return true;
+}
+
+// Reads the four hex digits of a \u escape into |u|. |p| points at the 'u',
+// and is left on the last digit.
+inline bool parse4hex(const char *&p, int &u) {
+  u = 0;
+  for (int i = 0; i < 4; ++i) {
+    const char ch = *++p;
+    u <<= 4;
+    if ('0' <= ch && ch <= '9') u |= ch - '0';
+    else if ('A' <= ch && ch <= 'F') u |= ch - 'A' + 10;
+    else if ('a' <= ch && ch <= 'f') u |= ch - 'a' + 10;
+    else return false;
+  }
+  return true;
+}
+
+} // namespace
+
+#endif //LIGHTJSON_GRAMMAR_H
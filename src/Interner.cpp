@@ -0,0 +1,37 @@
+#include "Interner.h"
+#include "JsonValue.h"
+
+using namespace ::lightjson;
+
+void Interner::intern(Json &json) {
+  auto &candidates = pool_[json.hash()];
+  for (const auto &candidate: candidates) {
+    if (candidate == json.value_) return;
+    if (Json(candidate) == json) {
+      json.value_ = candidate;
+      return;
+    }
+  }
+  candidates.push_back(json.value_);
+}
+
+// Nodes shared with another Json, e.g. a JsonSnapshot that other threads
+// read, are left as they are: only their own slot may be pointed at an equal
+// node. Their children are not descended into.
+void Interner::internTree(Json &json) {
+  if (json.value_.use_count() == 1) {
+    switch (json.getType()) {
+      case JsonType::kArray: {
+        if (json.value_->isPacked()) break;
+        for (auto &e: json.mutableValue().arrayItems()) internTree(e);
+        break;
+      }
+      case JsonType::kObject: {
+        for (auto &p: json.mutableValue().objectItems()) internTree(p.second);
+        break;
+      }
+      default: break;
+    }
+  }
+  intern(json);
+}
@@ -0,0 +1,33 @@
+#ifndef LIGHTJSON_INTERNER_H
+#define LIGHTJSON_INTERNER_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "../include/Json.h"
+
+namespace lightjson {
+
+// Hash-consing pool. Values are looked up by their structural hash and
+// replaced by an equal node seen before, so each distinct subtree or string
+// is stored once.
+class Interner {
+ public:
+  Interner() = default;
+  // Make the Interner uncopiable.
+  Interner(const Interner &) = delete;
+  Interner &operator=(const Interner &) = delete;
+
+  // Interns a single value. Its children are expected to be interned already,
+  // which makes comparing it against the candidates cheap.
+  void intern(Json &);
+  // Interns every value of the tree, children before their parents.
+  void internTree(Json &);
+
+ private:
+  std::unordered_map<size_t, std::vector<std::shared_ptr<JsonValue>>> pool_;
+};
+
+} // namespace
+
+#endif //LIGHTJSON_INTERNER_H
@@ -2,57 +2,99 @@
 // Created by William Liu on 2019-08-08.
 //
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
-#include <sstream>
-#include <iomanip>
+#include <thread>
 #include "../include/Json.h"
 #include "JsonValue.h"
 #include "Parser.h"
+#include "Formatter.h"
+#include "Dtoa.h"
+#include "Interner.h"
+#include "Number.h"
+#include "StringScan.h"
+#include "Utf8.h"
 #include "JsonType.h"
 
 using namespace ::lightjson;
 
 // Ctors
-Json::Json(std::nullptr_t) : value_(std::make_unique<JsonNull>(nullptr)) {}
-Json::Json(bool val) : value_(std::make_unique<JsonBool>(val)) {}
-Json::Json(double val) : value_(std::make_unique<JsonDouble>(val)) {}
+Json::Json(std::nullptr_t) : value_(std::make_shared<JsonNull>(nullptr)) {}
+Json::Json(bool val) : value_(std::make_shared<JsonBool>(val)) {}
+Json::Json(int val) : value_(std::make_shared<JsonInt64>(val)) {}
+Json::Json(long val) : value_(std::make_shared<JsonInt64>(val)) {}
+Json::Json(long long val) : value_(std::make_shared<JsonInt64>(val)) {}
+Json::Json(unsigned val) : value_(std::make_shared<JsonUint64>(val)) {}
+Json::Json(unsigned long val) : value_(std::make_shared<JsonUint64>(val)) {}
+Json::Json(unsigned long long val)
+    : value_(std::make_shared<JsonUint64>(val)) {}
+Json::Json(double val) : value_(std::make_shared<JsonDouble>(val)) {}
 Json::Json(const std::string &val)
-    : value_(std::make_unique<JsonString>(val)) {}
-Json::Json(std::string &&val) : value_(std::make_unique<JsonString>(std::move(
+    : value_(std::make_shared<JsonString>(val)) {}
+Json::Json(std::string &&val) : value_(std::make_shared<JsonString>(std::move(
     val))) {}
 Json::Json(const Json::array &val)
-    : value_(std::make_unique<JsonArray>(val)) {}
+    : value_(std::make_shared<JsonArray>(val)) {}
 Json::Json(Json::array &&val)
-    : value_(std::make_unique<JsonArray>(std::move(val))) {}
+    : value_(std::make_shared<JsonArray>(std::move(val))) {}
 Json::Json(const lightjson::Json::object &val)
-    : value_(std::make_unique<JsonObject>(val)) {}
+    : value_(std::make_shared<JsonObject>(val)) {}
 Json::Json(lightjson::Json::object &&val)
-    : value_(std::make_unique<JsonObject>(std::move(val))) {}
+    : value_(std::make_shared<JsonObject>(std::move(val))) {}
 // Copy ctor
+// Nodes that are already shared (see compact()) stay shared, anything else is
+// copied deeply.
 Json::Json(const Json &o) {
+  if (o.value_.use_count() > 1) {
+    value_ = o.value_;
+    return;
+  }
   switch (o.getType()) {
     case JsonType::kNull: {
-      value_ = std::make_unique<JsonNull>(nullptr);
+      value_ = std::make_shared<JsonNull>(nullptr);
       break;
     }
     case JsonType::kNumber: {
-      value_ = std::make_unique<JsonDouble>(o.toNumber());
+      const auto &num = o.value();
+      switch (num.numberKind()) {
+        case NumberKind::kDouble:
+          value_ = std::make_shared<JsonDouble>(num.toDouble());
+          break;
+        case NumberKind::kInt64:
+          value_ = std::make_shared<JsonInt64>(num.int64Value());
+          break;
+        case NumberKind::kUint64:
+          value_ = std::make_shared<JsonUint64>(num.uint64Value());
+          break;
+        case NumberKind::kRaw:
+          value_ = std::make_shared<JsonRawNumber>(
+              std::string(num.numberText()));
+          break;
+      }
       break;
     }
     case JsonType::kBool: {
-      value_ = std::make_unique<JsonBool>(o.toBool());
+      value_ = std::make_shared<JsonBool>(o.toBool());
       break;
     }
     case JsonType::kString: {
-      value_ = std::make_unique<JsonString>(o.toString());
+      value_ = std::make_shared<JsonString>(o.toString());
       break;
     }
     case JsonType::kArray: {
-      value_ = std::make_unique<JsonArray>(o.toArray());
+      const auto &arr = o.value();
+      if (const auto *numbers = arr.packedNumbers())
+        value_ = std::make_shared<JsonPackedNumbers>(
+            std::vector<double>(*numbers));
+      else if (const auto *bools = arr.packedBools())
+        value_ = std::make_shared<JsonPackedBools>(
+            std::vector<uint8_t>(*bools));
+      else value_ = std::make_shared<JsonArray>(o.toArray());
       break;
     }
     case JsonType::kObject: {
-      value_ = std::make_unique<JsonObject>(o.toObject());
+      value_ = std::make_shared<JsonObject>(o.toObject());
       break;
     }
   }
@@ -67,18 +109,65 @@ Json &Json::operator=(const Json &o) {
 Json::Json(Json &&o) noexcept = default;
 // Move assignment
 Json &Json::operator=(Json &&o) noexcept = default;
+namespace {
+
+CanonicalNumber canonicalNumberOf(const JsonValue &value) {
+  switch (value.numberKind()) {
+    case NumberKind::kInt64:
+      return lightjson::canonicalNumber(value.int64Value());
+    case NumberKind::kUint64:
+      return lightjson::canonicalNumber(value.uint64Value());
+    case NumberKind::kRaw: {
+      const auto &text = value.numberText();
+      return lightjson::canonicalNumber(text.data(), text.data() + text.size());
+    }
+    default: return lightjson::canonicalNumber(value.toDouble());
+  }
+}
+
+bool isUniqueContainer(const std::shared_ptr<JsonValue> &value) {
+  if (!value || value.use_count() != 1) return false;
+  const auto type = value->type();
+  // Packed arrays only hold scalars.
+  return (type == JsonType::kArray && !value->isPacked())
+      || type == JsonType::kObject;
+}
+
+} // namespace
+
 // Dtor
-// This has to be explicitly declared, otherwise would get an error:
-// In instantiation of 'void std::default_delete<_Tp>::operator()(_Tp*) const [with _Tp = lightjson::JsonValue]':
-// required from 'std::unique_ptr<_Tp, _Dp>::~unique_ptr() [with _Tp = lightjson::JsonValue; _Dp = std::default_delete<lightjson::JsonValue>]'
-// /Users/will/Desktop/LightJson/Json.h:26:7:   required from here
-// invalid application of 'sizeof' to incomplete type 'lightjson::JsonValue'
-// Not sure why this is...
-Json::~Json() = default;
+// Destroying a container destroys its children from within its own destructor,
+// which would overflow the stack on deep trees. Instead, the children that are
+// containers about to die as well are detached first and destroyed in a loop.
+Json::~Json() {
+  if (!isUniqueContainer(value_)) return;
+  std::vector<std::shared_ptr<JsonValue>> pending;
+  auto node = std::move(value_);
+  for (;;) {
+    if (node->type() == JsonType::kArray) {
+      for (auto &e: node->arrayItems())
+        if (isUniqueContainer(e.value_)) pending.push_back(std::move(e.value_));
+    } else {
+      for (auto &p: node->objectItems())
+        if (isUniqueContainer(p.second.value_))
+          pending.push_back(std::move(p.second.value_));
+    }
+    node.reset();
+    if (pending.empty()) return;
+    node = std::move(pending.back());
+    pending.pop_back();
+  }
+}
 // Public
 Json Json::parse(const std::string &data, std::string &error) {
+  return parse(data, error, ParseOptions());
+}
+
+Json Json::parse(const std::string &data,
+                 std::string &error,
+                 const ParseOptions &options) {
   try {
-    Parser p(data);
+    Parser p(data, options);
     return p.parse();
   } catch (JsonException &e) {
     error = e.what();
@@ -86,14 +175,55 @@ Json Json::parse(const std::string &data, std::string &error) {
   }
 }
 
-std::string Json::serialize() const {
-  switch (value_->type()) {
-    case JsonType::kNull: return "null";
-    case JsonType::kBool: return value_->toBool() ? "true" : "false";
-    case JsonType::kNumber: return serializeNumber();
-    case JsonType::kString: return serializeString();
-    case JsonType::kArray: return serializeArray();
-    default:return serializeObject();
+std::string Json::serialize(bool compact) const {
+  SerializeOptions options;
+  options.compact = compact;
+  return serialize(options);
+}
+
+std::string Json::serialize(const SerializeOptions &options) const {
+  std::string retVal;
+  serialize(retVal, options);
+  return retVal;
+}
+
+std::string Json::minify(const std::string &data, std::string &error) {
+  std::string retVal;
+  retVal.reserve(data.size());
+  try {
+    Formatter(data, retVal, -1).format();
+  } catch (JsonException &e) {
+    error = e.what();
+    retVal.clear();
+  }
+  return retVal;
+}
+
+std::string Json::prettify(const std::string &data,
+                           int indent,
+                           std::string &error) {
+  std::string retVal;
+  retVal.reserve(data.size());
+  try {
+    Formatter(data, retVal, indent < 0 ? 0 : indent).format();
+  } catch (JsonException &e) {
+    error = e.what();
+    retVal.clear();
+  }
+  return retVal;
+}
+
+bool Json::validate(const std::string &data, std::string &error) {
+  try {
+    const char *end = data.data() + data.size();
+    if (!isValidUtf8(data.data(), end))
+      throw JsonException(std::string("Invalid UTF-8: ")
+                              + findInvalidUtf8(data.data(), end));
+    Formatter(data, ParseOptions().maxDepth).format();
+    return true;
+  } catch (JsonException &e) {
+    error = e.what();
+    return false;
   }
 }
 
@@ -110,36 +240,250 @@ bool Json::isObject() const noexcept { return getType() == JsonType::kObject; }
 
 bool Json::toBool() const { return value_->toBool(); }
 double Json::toNumber() const { return value_->toDouble(); }
+int64_t Json::toInt64() const {
+  if (value_->numberKind() == NumberKind::kInt64) return value_->int64Value();
+  int64_t retVal;
+  if (!lightjson::toInt64(canonicalNumberOf(*value_), retVal))
+    throw JsonException("Number is not a 64-bit integer");
+  return retVal;
+}
+uint64_t Json::toUint64() const {
+  if (value_->numberKind() == NumberKind::kUint64) return value_->uint64Value();
+  uint64_t retVal;
+  if (!lightjson::toUint64(canonicalNumberOf(*value_), retVal))
+    throw JsonException("Number is not an unsigned 64-bit integer");
+  return retVal;
+}
 std::string Json::toString() const { return value_->toString(); }
 Json::array Json::toArray() const { return value_->toArray(); }
 Json::object Json::toObject() const { return value_->toObject(); }
 
 size_t Json::size() const { return value_->size(); }
 
+const std::vector<double> *Json::packedNumbers() const {
+  return value_->packedNumbers();
+}
+const std::vector<uint8_t> *Json::packedBools() const {
+  return value_->packedBools();
+}
+
+void Json::push_back(const Json &val) {
+  mutableValue().arrayItems().push_back(val);
+}
+void Json::push_back(Json &&val) {
+  mutableValue().arrayItems().push_back(std::move(val));
+}
+void Json::insert(size_t pos, const Json &val) {
+  insert(pos, Json(val));
+}
+void Json::insert(size_t pos, Json &&val) {
+  auto &arr = mutableValue().arrayItems();
+  if (pos > arr.size()) throw JsonException("Index out of range");
+  arr.insert(arr.begin() + pos, std::move(val));
+}
+void Json::erase(size_t pos) {
+  auto &arr = mutableValue().arrayItems();
+  if (pos >= arr.size()) throw JsonException("Index out of range");
+  arr.erase(arr.begin() + pos);
+}
+
+bool Json::insert(std::string key, const Json &val) {
+  return mutableValue().objectItems().emplace(std::move(key), val).second;
+}
+bool Json::insert(std::string key, Json &&val) {
+  return mutableValue().objectItems().emplace(std::move(key), std::move(val)).second;
+}
+Json &Json::insert_or_assign(std::string key, const Json &val) {
+  return insert_or_assign(std::move(key), Json(val));
+}
+Json &Json::insert_or_assign(std::string key, Json &&val) {
+  auto &obj = mutableValue().objectItems();
+  auto it = obj.find(key);
+  if (it == obj.end())
+    return obj.emplace(std::move(key), std::move(val)).first->second;
+  it->second = std::move(val);
+  return it->second;
+}
+size_t Json::erase(const std::string &key) {
+  return mutableValue().objectItems().erase(key);
+}
+
+void Json::compact() {
+  Interner().internTree(*this);
+}
+
+void Json::clear() {
+  if (isArray()) mutableValue().arrayItems().clear();
+  else mutableValue().objectItems().clear();
+}
+
 Json &Json::operator[](size_t pos) {
-  return value_->operator[](pos);
+  return mutableValue().operator[](pos);
 }
 const Json &Json::operator[](size_t pos) const {
-  return value_->operator[](pos);
+  return value().operator[](pos);
 }
 
 Json &Json::operator[](const std::string &key) {
-  return value_->operator[](key);
+  return mutableValue().operator[](key);
 }
 
 const Json &Json::operator[](const std::string &key) const {
-  return value_->operator[](key);
+  return value().operator[](key);
+}
+
+namespace {
+
+// Keys given as a pointer and a size are copied here to be looked up. The
+// buffer is reused, so only a key longer than any before it on this thread
+// allocates.
+const std::string &keyBuffer(const char *key, size_t size) {
+  thread_local std::string buffer;
+  buffer.assign(key, size);
+  return buffer;
+}
+
+} // namespace
+
+Json *Json::find(const std::string &key) {
+  return mutableValue().find(key);
+}
+const Json *Json::find(const std::string &key) const {
+  return value().find(key);
+}
+Json *Json::find(const char *key, size_t size) {
+  return find(keyBuffer(key, size));
+}
+const Json *Json::find(const char *key, size_t size) const {
+  return find(keyBuffer(key, size));
+}
+
+Json &Json::lookup(const char *key, size_t size) {
+  return mutableValue().operator[](keyBuffer(key, size));
+}
+const Json &Json::lookup(const char *key, size_t size) const {
+  return value().operator[](keyBuffer(key, size));
+}
+
+namespace {
+
+// splitmix64's finalizer.
+size_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// The hashes of scalars, shared by the elements of packed arrays, which have
+// no node to go through.
+size_t hashBool(bool val) {
+  return mix(static_cast<size_t>(JsonType::kBool) + 1 + val);
+}
+
+size_t hashNumber(const CanonicalNumber &num) {
+  const size_t h = static_cast<size_t>(JsonType::kNumber) + 1;
+  if (num.isInteger) return mix(mix(h + num.negative) ^ num.magnitude);
+  uint64_t bits;
+  std::memcpy(&bits, &num.value, sizeof(bits));
+  return mix(h ^ bits);
+}
+
+void appendPointerToken(const std::string &token, std::string &path) {
+  path += '/';
+  for (auto ch: token) {
+    if (ch == '~') path += "~0";
+    else if (ch == '/') path += "~1";
+    else path += ch;
+  }
+}
+
+} // namespace
+
+size_t Json::hash() const {
+  if (value_->hashed()) return value_->hash();
+  size_t h = static_cast<size_t>(getType()) + 1;
+  switch (getType()) {
+    case JsonType::kNull: break;
+    case JsonType::kBool: {
+      h = hashBool(value_->toBool());
+      break;
+    }
+    case JsonType::kNumber: {
+      // Equal numbers may be stored differently, e.g. 1, 1.0 and -0.0 == 0,
+      // so the canonical form is hashed.
+      h = hashNumber(canonicalNumberOf(*value_));
+      break;
+    }
+    case JsonType::kString: {
+      h = mix(h ^ std::hash<std::string>()(value().stringValue()));
+      break;
+    }
+    case JsonType::kArray: {
+      if (const auto *numbers = value_->packedNumbers()) {
+        for (auto e: *numbers)
+          h = mix(h * 31 + hashNumber(canonicalNumber(e)));
+      } else if (const auto *bools = value_->packedBools()) {
+        for (auto e: *bools) h = mix(h * 31 + hashBool(e != 0));
+      } else {
+        for (const auto &e: value().arrayItems())
+          h = mix(h * 31 + e.hash());
+      }
+      break;
+    }
+    case JsonType::kObject: {
+      // Sum the members so that the iteration order does not matter.
+      size_t sum = 0;
+      for (const auto &p: value().objectItems())
+        sum += mix(std::hash<std::string>()(p.first) ^ p.second.hash());
+      h = mix(h ^ sum ^ value_->size());
+      break;
+    }
+  }
+  value_->setHash(h);
+  return h;
+}
+
+std::vector<std::string> Json::diff(const Json &from, const Json &to) {
+  std::vector<std::string> paths;
+  std::string path;
+  diff(from, to, path, paths);
+  return paths;
 }
 
 bool Json::operator==(const lightjson::Json &o) const {
+  if (this == &o || value_ == o.value_) return true;
   if (this->getType() != o.getType()) return false;
   switch (this->getType()) {
     case JsonType::kNull: return true;
     case JsonType::kBool: return this->toBool() == o.toBool();
-    case JsonType::kNumber: return this->toNumber() == o.toNumber();
-    case JsonType::kString: return this->toString() == o.toString();
-    case JsonType::kArray: return this->toArray() == o.toArray();
-    case JsonType::kObject: return this->toObject() == o.toObject();
+    case JsonType::kNumber:
+      return canonicalNumberOf(value()) == canonicalNumberOf(o.value());
+    case JsonType::kString:
+      return value().stringValue() == o.value().stringValue();
+    case JsonType::kArray: {
+      // Packed arrays are compared without building their elements. A double
+      // compares equal to another exactly when their canonical forms do.
+      const auto *numbers = value_->packedNumbers();
+      const auto *otherNumbers = o.value_->packedNumbers();
+      if (numbers && otherNumbers) return *numbers == *otherNumbers;
+      const auto *bools = value_->packedBools();
+      const auto *otherBools = o.value_->packedBools();
+      if (bools && otherBools) return *bools == *otherBools;
+      return value().arrayItems() == o.value().arrayItems();
+    }
+    case JsonType::kObject: {
+      const auto &obj = value().objectItems();
+      const auto &other = o.value().objectItems();
+      if (obj.size() != other.size()) return false;
+      for (const auto &p: obj) {
+        auto it = other.find(p.first);
+        if (it == other.end() || !(p.second == it->second)) return false;
+      }
+      return true;
+    }
     default: return false;
   }
 }
@@ -148,77 +492,262 @@ void Json::swap(Json &o) noexcept {
   std::swap(value_, o.value_);
 }
 
-std::string Json::serializeNumber() const {
-  char buf[32];
-  snprintf(buf, sizeof(buf), "%.17g", value_->toDouble());
-  return buf;
+JsonValue &Json::mutableValue() {
+  if (value_.use_count() > 1) {
+    // Copy on write. Scalars are never modified in place, only containers
+    // need to be unshared. The copy shares the children, which are unshared
+    // in turn when something modifies them.
+    if (isArray()) {
+      Json::array arr;
+      arr.reserve(size());
+      for (const auto &e: value().arrayItems()) arr.push_back(Json(e.value_));
+      value_ = std::make_shared<JsonArray>(std::move(arr));
+    } else if (isObject()) {
+      Json::object obj;
+      obj.reserve(size());
+      for (const auto &p: value().objectItems())
+        obj.emplace(p.first, Json(p.second.value_));
+      value_ = std::make_shared<JsonObject>(std::move(obj));
+    }
+  }
+  return *value_;
 }
 
-std::string Json::serializeString() const {
-  std::string retVal{"\""};
-  for (auto ch: value_->toString()) {
-    switch (ch) {
-      case '\"': {
-        retVal += "\\\"";
-        break;
-      }
-      case '\\': {
-        retVal += "\\\\";
-        break;
-      }
-      case '\b': {
-        retVal += "\\b";
+void Json::diff(const Json &from,
+                const Json &to,
+                std::string &path,
+                std::vector<std::string> &paths) {
+  // Equal hashes only suggest that the subtrees are the same: a cached hash
+  // can be stale, and different values can collide.
+  if (from.hash() == to.hash() && from == to) return;
+  if (from.isArray() && to.isArray()) {
+    const auto &a = from.value().arrayItems();
+    const auto &b = to.value().arrayItems();
+    const auto size = path.size();
+    for (size_t i = 0; i != std::max(a.size(), b.size()); ++i) {
+      appendPointerToken(std::to_string(i), path);
+      if (i < a.size() && i < b.size()) diff(a[i], b[i], path, paths);
+      else paths.push_back(path);
+      path.resize(size);
+    }
+  } else if (from.isObject() && to.isObject()) {
+    const auto &a = from.value().objectItems();
+    const auto &b = to.value().objectItems();
+    const auto size = path.size();
+    for (const auto &p: a) {
+      appendPointerToken(p.first, path);
+      auto it = b.find(p.first);
+      if (it == b.end()) paths.push_back(path);
+      else diff(p.second, it->second, path, paths);
+      path.resize(size);
+    }
+    for (const auto &p: b) {
+      if (a.count(p.first)) continue;
+      appendPointerToken(p.first, path);
+      paths.push_back(path);
+      path.resize(size);
+    }
+  } else if (!(from == to)) {
+    paths.push_back(path);
+  }
+}
+
+// Containers are written without recursion, like Parser reads them: the outer
+// loop writes one value or opens a container, the inner loop moves on to the
+// next member and closes the containers that are done.
+void Json::serialize(std::string &out, const SerializeOptions &options) const {
+  const unsigned threads =
+      options.threads ? options.threads : std::thread::hardware_concurrency();
+  if (threads > 1) serializeParallel(out, options, threads);
+  else serializeTree(out, options);
+}
+
+void Json::serializeTree(std::string &out,
+                         const SerializeOptions &options) const {
+  const char *comma = options.compact ? "," : ", ";
+  const char *colon = options.compact ? ":" : ": ";
+  const bool asciiOnly = options.asciiOnly;
+  struct Frame {
+    const JsonValue *node;
+    size_t index;
+    object::const_iterator member;
+  };
+  std::vector<Frame> frames;
+  const Json *curr = this;
+  for (;;) {
+    const auto &value = curr->value();
+    switch (value.type()) {
+      case JsonType::kNull: {
+        out += "null";
         break;
       }
-      case '\f': {
-        retVal += "\\f";
+      case JsonType::kBool: {
+        out += value.toBool() ? "true" : "false";
         break;
       }
-      case '\n': {
-        retVal += "\\n";
+      case JsonType::kNumber: {
+        curr->serializeNumber(out);
         break;
       }
-      case '\r': {
-        retVal += "\\r";
+      case JsonType::kString: {
+        serializeString(value.stringValue(), out, asciiOnly);
         break;
       }
-      case '\t': {
-        retVal += "\\t";
-        break;
+      case JsonType::kArray: {
+        if (value.isPacked()) {
+          serializePacked(value, out, comma);
+          break;
+        }
+        const auto &arr = value.arrayItems();
+        if (arr.empty()) {
+          out += "[]";
+          break;
+        }
+        out += '[';
+        frames.push_back({&value, 0, {}});
+        curr = &arr[0];
+        continue;
       }
       default: {
-        auto v = static_cast<unsigned>(ch);
-        if (v < 0x20) {
-          std::stringstream ss;
-          ss << "\\u" << std::setfill('0') << std::setw(4) << v;
-          retVal += ss.str();
-        } else {
-          retVal += ch;
+        const auto &obj = value.objectItems();
+        if (obj.empty()) {
+          out += "{}";
+          break;
+        }
+        out += '{';
+        frames.push_back({&value, 0, obj.begin()});
+        serializeString(obj.begin()->first, out, asciiOnly);
+        out += colon;
+        curr = &obj.begin()->second;
+        continue;
+      }
+    }
+    for (;;) {
+      if (frames.empty()) return;
+      auto &frame = frames.back();
+      if (frame.node->type() == JsonType::kArray) {
+        const auto &arr = frame.node->arrayItems();
+        if (++frame.index != arr.size()) {
+          out += comma;
+          curr = &arr[frame.index];
+          break;
+        }
+        out += ']';
+      } else {
+        if (++frame.member != frame.node->objectItems().end()) {
+          out += comma;
+          serializeString(frame.member->first, out, asciiOnly);
+          out += colon;
+          curr = &frame.member->second;
+          break;
         }
+        out += '}';
       }
+      frames.pop_back();
     }
   }
-  return retVal + '"';
 }
 
-std::string Json::serializeArray() const {
-  std::string retVal{"["};
-  for (auto i = 0; i != value_->size(); ++i) {
-    if (i > 0) retVal += ", ";
-    retVal += (*this)[i].serialize();
+void Json::serializePacked(const JsonValue &value,
+                           std::string &out,
+                           const char *comma) {
+  out += '[';
+  if (const auto *numbers = value.packedNumbers()) {
+    char buf[kDoubleBufferSize];
+    for (size_t i = 0; i != numbers->size(); ++i) {
+      if (i) out += comma;
+      out.append(buf, formatDouble(buf, (*numbers)[i]));
+    }
+  } else {
+    const auto &bools = *value.packedBools();
+    for (size_t i = 0; i != bools.size(); ++i) {
+      if (i) out += comma;
+      out += bools[i] ? "true" : "false";
+    }
   }
-  return retVal + "]";
+  out += ']';
 }
 
-std::string Json::serializeObject() const {
-  std::string retVal{"{"};
-  bool seen1st = false;
-  for (const auto &p: value_->toObject()) {
-    if (!seen1st) seen1st = true;
-    else retVal += ", ";
-    retVal += "\"" + p.first + "\"";
-    retVal += ": ";
-    retVal += p.second.serialize();
+void Json::serializeNumber(std::string &out) const {
+  char buf[kDoubleBufferSize];
+  switch (value_->numberKind()) {
+    case NumberKind::kDouble:
+      out.append(buf, formatDouble(buf, value_->toDouble()));
+      break;
+    case NumberKind::kInt64:
+      out.append(buf, formatInteger(buf, value_->int64Value()));
+      break;
+    case NumberKind::kUint64:
+      out.append(buf, formatInteger(buf, value_->uint64Value()));
+      break;
+    case NumberKind::kRaw: out += value_->numberText();
   }
-  return retVal + "}";
-}
\ No newline at end of file
+}
+
+namespace {
+
+// JSON escapes for the control characters.
+const char *const kControlEscapes[0x20] = {
+    "\\u0000", "\\u0001", "\\u0002", "\\u0003",
+    "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+    "\\b", "\\t", "\\n", "\\u000b",
+    "\\f", "\\r", "\\u000e", "\\u000f",
+    "\\u0010", "\\u0011", "\\u0012", "\\u0013",
+    "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+    "\\u0018", "\\u0019", "\\u001a", "\\u001b",
+    "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+};
+
+void appendEscapedCodeUnit(uint32_t u, std::string &out) {
+  static const char kHex[] = "0123456789abcdef";
+  const char escape[] = {'\\', 'u',
+                         kHex[(u >> 12) & 0xf], kHex[(u >> 8) & 0xf],
+                         kHex[(u >> 4) & 0xf], kHex[u & 0xf]};
+  out.append(escape, sizeof(escape));
+}
+
+} // namespace
+
+// Runs of characters that need no escaping are found 16 bytes at a time and
+// copied in one go.
+void Json::serializeString(const char *str,
+                           size_t size,
+                           std::string &out,
+                           bool asciiOnly) {
+  out += '"';
+  const char *p = str;
+  const char *const end = p + size;
+  for (;;) {
+    const char *run = p;
+    p = asciiOnly ? skipUnescapedAscii(p, end) : skipUnescaped(p, end);
+    out.append(run, p);
+    if (p == end) break;
+    const auto ch = static_cast<unsigned char>(*p);
+    if (ch == '"') {
+      out += "\\\"";
+      ++p;
+    } else if (ch == '\\') {
+      out += "\\\\";
+      ++p;
+    } else if (ch < 0x20) {
+      out += kControlEscapes[ch];
+      ++p;
+    } else {
+      uint32_t u;
+      size_t size = decodeUtf8(p, end, u);
+      if (!size) {
+        u = 0xfffd;
+        size = 1;
+      }
+      p += size;
+      if (u < 0x10000) {
+        appendEscapedCodeUnit(u, out);
+      } else {
+        u -= 0x10000;
+        appendEscapedCodeUnit(0xd800 + (u >> 10), out);
+        appendEscapedCodeUnit(0xdc00 + (u & 0x3ff), out);
+      }
+    }
+  }
+  out += '"';
+}
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+#include "../include/Json.h"
+#include "JsonValue.h"
+#include "JsonException.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+// Splits an RFC 6901 JSON Pointer into unescaped reference tokens. The empty
+// pointer refers to the whole document and has no tokens.
+std::vector<std::string> splitPointer(const std::string &pointer) {
+  std::vector<std::string> tokens;
+  if (pointer.empty()) return tokens;
+  if (pointer[0] != '/') throw JsonException("Invalid pointer: " + pointer);
+  for (size_t i = 0; i != pointer.size(); ++i) {
+    const char ch = pointer[i];
+    if (ch == '/') {
+      tokens.emplace_back();
+    } else if (ch == '~') {
+      const char next = i + 1 < pointer.size() ? pointer[++i] : '\0';
+      if (next == '0') tokens.back() += '~';
+      else if (next == '1') tokens.back() += '/';
+      else throw JsonException("Invalid pointer: " + pointer);
+    } else {
+      tokens.back() += ch;
+    }
+  }
+  return tokens;
+}
+
+// Array indices are decimal without leading zeros, and fit a size_t. Returns
+// false otherwise.
+bool parseIndex(const std::string &token, size_t &index) {
+  if (token.empty() || (token[0] == '0' && token.size() > 1)) return false;
+  constexpr auto kMax = std::numeric_limits<size_t>::max();
+  index = 0;
+  for (auto ch: token) {
+    if (ch < '0' || ch > '9') return false;
+    const size_t digit = ch - '0';
+    if (index > (kMax - digit) / 10) return false;
+    index = index * 10 + digit;
+  }
+  return true;
+}
+
+const Json &member(const Json &op, const std::string &key) {
+  if (!op.isObject()) throw JsonException("Invalid patch operation");
+  try {
+    return op[key];
+  } catch (JsonException &e) {
+    throw JsonException("Patch operation is missing \"" + key + "\"");
+  }
+}
+
+} // namespace
+
+void Json::mergePatch(const Json &patch) {
+  if (!patch.isObject()) {
+    *this = patch;
+    return;
+  }
+  if (!isObject()) *this = Json(Json::object{});
+  auto &obj = mutableValue().objectItems();
+  for (const auto &p: patch.value().objectItems()) {
+    if (p.second.isNull()) {
+      obj.erase(p.first);
+      continue;
+    }
+    auto it = obj.find(p.first);
+    if (it == obj.end()) it = obj.emplace(p.first, Json(nullptr)).first;
+    it->second.mergePatch(p.second);
+  }
+}
+
+void Json::mergePatch(Json &&patch) {
+  if (!patch.isObject()) {
+    *this = std::move(patch);
+    return;
+  }
+  if (!isObject()) *this = Json(Json::object{});
+  auto &obj = mutableValue().objectItems();
+  for (auto &p: patch.mutableValue().objectItems()) {
+    if (p.second.isNull()) {
+      obj.erase(p.first);
+      continue;
+    }
+    auto it = obj.find(p.first);
+    if (it == obj.end()) it = obj.emplace(p.first, Json(nullptr)).first;
+    it->second.mergePatch(std::move(p.second));
+  }
+}
+
+bool Json::applyPatch(const Json &patch, std::string &error) {
+  try {
+    if (!patch.isArray()) throw JsonException("Patch is not an array");
+    for (const auto &op: patch.value().arrayItems())
+      applyPatchOperation(op);
+    return true;
+  } catch (JsonException &e) {
+    error = e.what();
+    return false;
+  }
+}
+
+void Json::applyPatchOperation(const Json &op) {
+  const auto &name = member(op, "op");
+  if (!name.isString()) throw JsonException("Invalid patch operation");
+  const auto kind = name.toString();
+  const auto &path = member(op, "path");
+  if (!path.isString()) throw JsonException("Invalid patch operation");
+  const auto tokens = splitPointer(path.toString());
+
+  Json val;
+  if (kind == "add" || kind == "replace" || kind == "test") {
+    val = member(op, "value");
+  } else if (kind == "move" || kind == "copy") {
+    const auto &from = member(op, "from");
+    if (!from.isString()) throw JsonException("Invalid patch operation");
+    const auto fromTokens = splitPointer(from.toString());
+    Json *source = resolvePointer(fromTokens, fromTokens.size());
+    if (!source) throw JsonException("Path not found: " + from.toString());
+    if (kind == "copy") {
+      val = *source;
+    } else {
+      // A value cannot be moved into one of its own children.
+      if (fromTokens.size() < tokens.size()
+          && std::equal(fromTokens.begin(), fromTokens.end(), tokens.begin()))
+        throw JsonException("Cannot move a value into itself");
+      val = std::move(*source);
+      if (fromTokens.empty()) {
+        *this = std::move(val);
+        return;
+      }
+      Json *parent = resolvePointer(fromTokens, fromTokens.size() - 1);
+      size_t index = 0;
+      const bool fromObject = parent->isObject();
+      if (fromObject) parent->erase(fromTokens.back());
+      else if (parseIndex(fromTokens.back(), index)) parent->erase(index);
+      // The target is resolved after the removal, as RFC 6902 has it. If it
+      // does not exist, the value goes back where it came from, so that the
+      // failed operation leaves nothing behind. Resolving the target may
+      // have unshared the source's parent, so it is looked up again.
+      try {
+        applyPatchValue(kind, tokens, path.toString(), val);
+      } catch (JsonException &) {
+        parent = resolvePointer(fromTokens, fromTokens.size() - 1);
+        if (fromObject)
+          parent->insert_or_assign(fromTokens.back(), std::move(val));
+        else parent->insert(index, std::move(val));
+        throw;
+      }
+      return;
+    }
+  } else if (kind != "remove") {
+    throw JsonException("Unknown patch operation: " + kind);
+  }
+  applyPatchValue(kind, tokens, path.toString(), val);
+}
+
+// Applies the part of an operation that takes place at its "path". |val| is
+// only moved from once nothing can fail anymore.
+void Json::applyPatchValue(const std::string &kind,
+                           const std::vector<std::string> &tokens,
+                           const std::string &path,
+                           Json &val) {
+  if (kind == "test") {
+    Json *target = resolvePointer(tokens, tokens.size());
+    if (!target || !(*target == val))
+      throw JsonException("Test failed: " + path);
+    return;
+  }
+  if (tokens.empty()) {
+    if (kind == "remove") *this = Json(nullptr);
+    else *this = std::move(val);
+    return;
+  }
+
+  Json *parent = resolvePointer(tokens, tokens.size() - 1);
+  if (!parent) throw JsonException("Path not found: " + path);
+  const auto &last = tokens.back();
+  if (parent->isObject()) {
+    auto &obj = parent->mutableValue().objectItems();
+    if (kind == "add" || kind == "move" || kind == "copy") {
+      parent->insert_or_assign(last, std::move(val));
+      return;
+    }
+    auto it = obj.find(last);
+    if (it == obj.end())
+      throw JsonException("Path not found: " + path);
+    if (kind == "remove") obj.erase(it);
+    else it->second = std::move(val);
+    return;
+  }
+  if (!parent->isArray())
+    throw JsonException("Path not found: " + path);
+  size_t index;
+  if (kind == "add" || kind == "move" || kind == "copy") {
+    if (last == "-") parent->push_back(std::move(val));
+    else if (parseIndex(last, index) && index <= parent->size())
+      parent->insert(index, std::move(val));
+    else throw JsonException("Invalid index: " + path);
+    return;
+  }
+  if (!parseIndex(last, index) || index >= parent->size())
+    throw JsonException("Invalid index: " + path);
+  if (kind == "remove") parent->erase(index);
+  else (*parent)[index] = std::move(val);
+}
+
+// Follows the first |count| tokens from this value. Returns nullptr if one of
+// them does not exist.
+Json *Json::resolvePointer(const std::vector<std::string> &tokens,
+                           size_t count) {
+  Json *curr = this;
+  for (size_t i = 0; i != count; ++i) {
+    if (curr->isObject()) {
+      auto &obj = curr->mutableValue().objectItems();
+      auto it = obj.find(tokens[i]);
+      if (it == obj.end()) return nullptr;
+      curr = &it->second;
+    } else if (curr->isArray()) {
+      size_t index;
+      if (!parseIndex(tokens[i], index) || index >= curr->size())
+        return nullptr;
+      curr = &(*curr)[index];
+    } else {
+      return nullptr;
+    }
+  }
+  return curr;
+}
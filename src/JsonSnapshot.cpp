@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <new>
+#include "../include/JsonSnapshot.h"
+
+using namespace ::lightjson;
+
+// hash() caches the hash of every node on the way, which is the last write
+// the tree ever sees.
+JsonSnapshot::JsonSnapshot(Json &&json)
+    : root_(std::move(json)), hash_(root_.hash()) {}
+
+JsonSnapshot::Ptr JsonSnapshot::create(Json json) {
+  return Ptr(new JsonSnapshot(std::move(json)));
+}
+
+namespace {
+
+// current_ holds the address of a Holder in its low 48 bits, which is all
+// the address space x86-64 and AArch64 hand out, and the count of claims in
+// the 16 bits above, enough for 65535 load()s at the very same time.
+constexpr int kCountShift = 48;
+constexpr uint64_t kOneClaim = uint64_t{1} << kCountShift;
+constexpr uint64_t kAddressMask = kOneClaim - 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "AtomicSnapshot needs lock-free 64-bit atomics");
+
+} // namespace
+
+// A published snapshot. Once replaced, the claims that were still counted in
+// current_ are moved to |claims|, and each load() gives its claim back there.
+struct AtomicSnapshot::Holder {
+  explicit Holder(JsonSnapshot::Ptr snapshot) : snapshot(std::move(snapshot)) {}
+
+  const JsonSnapshot::Ptr snapshot;
+  std::atomic<int64_t> claims{0};
+};
+
+namespace {
+
+// The word for a Holder nobody has claimed yet.
+uint64_t toWord(const void *holder) {
+  const auto address = reinterpret_cast<uintptr_t>(holder);
+  if (address & ~kAddressMask) throw std::bad_alloc();
+  return address;
+}
+
+} // namespace
+
+AtomicSnapshot::AtomicSnapshot()
+    : AtomicSnapshot(JsonSnapshot::create(Json())) {}
+
+AtomicSnapshot::AtomicSnapshot(JsonSnapshot::Ptr snapshot) {
+  std::unique_ptr<Holder> holder(new Holder(std::move(snapshot)));
+  current_.store(toWord(holder.get()));
+  holder.release();
+}
+
+// Nobody may load() anymore, so every claim has been given back.
+AtomicSnapshot::~AtomicSnapshot() {
+  delete reinterpret_cast<Holder *>(current_.load() & kAddressMask);
+}
+
+JsonSnapshot::Ptr AtomicSnapshot::load() const {
+  // The claim keeps the Holder alive while its pointer is copied out.
+  uint64_t word = current_.fetch_add(kOneClaim, std::memory_order_acquire);
+  const auto address = word & kAddressMask;
+  auto *holder = reinterpret_cast<Holder *>(address);
+  auto snapshot = holder->snapshot;
+  // Give the claim back where it is counted now. A Holder isn't freed while
+  // it is claimed, so its address can't come back as a new one meanwhile.
+  word += kOneClaim;
+  while ((word & kAddressMask) == address) {
+    if (current_.compare_exchange_weak(word, word - kOneClaim,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed))
+      return snapshot;
+  }
+  holder->claims.fetch_sub(1, std::memory_order_release);
+  return snapshot;
+}
+
+void AtomicSnapshot::publish(JsonSnapshot::Ptr snapshot) {
+  std::unique_ptr<Holder> holder(new Holder(std::move(snapshot)));
+  const uint64_t word = toWord(holder.get());
+  std::lock_guard<std::mutex> lock(mutex_);
+  retired_.reserve(retired_.size() + 1);
+  const uint64_t old = current_.exchange(word, std::memory_order_acq_rel);
+  holder.release();
+  retired_.emplace_back(reinterpret_cast<Holder *>(old & kAddressMask));
+  retired_.back()->claims.fetch_add(static_cast<int64_t>(old >> kCountShift),
+                                    std::memory_order_relaxed);
+  reclaimLocked();
+}
+
+size_t AtomicSnapshot::reclaim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return reclaimLocked();
+}
+
+// A retired snapshot can't be loaded anymore. Once no load() is still
+// copying it out and |retired_| holds the only reference, nobody can get a
+// new one.
+size_t AtomicSnapshot::reclaimLocked() {
+  retired_.erase(std::remove_if(retired_.begin(),
+                                retired_.end(),
+                                [](const std::unique_ptr<Holder> &p) {
+                                  return p->claims.load(
+                                      std::memory_order_acquire) == 0
+                                      && p->snapshot.use_count() == 1;
+                                }),
+                 retired_.end());
+  return retired_.size();
+}
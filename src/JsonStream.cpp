@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstring>
+#include "../include/JsonStream.h"
+#include "Codec.h"
+#include "JsonException.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+// How much compressed input is read at a time.
+constexpr size_t kInputSize = 64 * 1024;
+
+} // namespace
+
+JsonStream::JsonStream(Source source, const StreamOptions &options)
+    : source_(std::move(source)), options_(options) {
+  thread_ = std::thread(&JsonStream::decompress, this);
+}
+
+JsonStream::~JsonStream() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  space_.notify_one();
+  thread_.join();
+}
+
+bool JsonStream::next(Json &json, std::string &error) {
+  for (;;) {
+    if (!error_.empty()) {
+      error = error_;
+      return false;
+    }
+    const char *newline = static_cast<const char *>(
+        memchr(&data_[scanned_], '\n', data_.size() - scanned_));
+    if (newline || (ended_ && pos_ != data_.size())) {
+      const size_t end = newline ? newline - data_.data() : data_.size();
+      record_.assign(data_, pos_, end - pos_);
+      pos_ = scanned_ = newline ? end + 1 : end;
+      ++line_;
+      if (!record_.empty() && record_.back() == '\r') record_.pop_back();
+      if (record_.find_first_not_of(" \t") == std::string::npos) continue;
+      json = context_.parse(record_, error_, options_.parse);
+      if (error_.empty()) return true;
+      error_ = "Line " + std::to_string(line_) + ": " + error_;
+      continue;
+    }
+    scanned_ = data_.size();
+    if (ended_) return false;
+    // Only the record in progress is kept.
+    data_.erase(0, pos_);
+    scanned_ -= pos_;
+    pos_ = 0;
+    std::string chunk;
+    if (!take(chunk)) {
+      ended_ = true;
+      continue;
+    }
+    if (data_.empty()) data_.swap(chunk);
+    else data_ += chunk;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (spare_.size() <= options_.maxChunks) spare_.push_back(std::move(chunk));
+  }
+}
+
+Json JsonStream::parse(std::string &error) {
+  if (!error_.empty()) {
+    error = error_;
+    return Json(nullptr);
+  }
+  std::string text = data_.substr(pos_);
+  data_.clear();
+  pos_ = scanned_ = 0;
+  std::string chunk;
+  while (take(chunk)) text += chunk;
+  ended_ = true;
+  if (!error_.empty()) {
+    error = error_;
+    return Json(nullptr);
+  }
+  return context_.parse(text, error, options_.parse);
+}
+
+// Runs on the decompression thread until the stream ends, fails or the
+// JsonStream is destroyed. It checks for the latter before every call to
+// source_, and while it waits for room for a chunk.
+void JsonStream::decompress() {
+  try {
+    std::vector<char> input(kInputSize);
+    // Enough of the start to recognize the format.
+    size_t size = 0;
+    for (size_t n; size < 4
+        && (n = source_(input.data() + size, input.size() - size));)
+      size += n;
+    auto codec = makeCodec(options_.compression, input.data(), size);
+    const size_t chunkSize = std::max<size_t>(options_.chunkSize, 1);
+    std::string chunk = spare();
+    chunk.resize(chunkSize);
+    size_t filled = 0;
+    while (size) {
+      const char *in = input.data();
+      const char *const end = in + size;
+      bool full;
+      do {
+        const char *before = in;
+        const size_t written =
+            codec->decompress(in, end, &chunk[filled], chunkSize - filled);
+        filled += written;
+        full = filled == chunkSize;
+        if (full) {
+          if (!push(chunk)) return;
+          chunk = spare();
+          chunk.resize(chunkSize);
+          filled = 0;
+        } else if (!written && in == before && in != end) {
+          throw JsonException("Invalid compressed data");
+        }
+      } while (in != end || full);
+      // Without this, a stream destroyed while input trickles in would be
+      // read until the next chunk fills up.
+      if (stopping()) return;
+      size = source_(input.data(), input.size());
+    }
+    codec->finish();
+    chunk.resize(filled);
+    if (filled && !push(chunk)) return;
+  } catch (std::exception &e) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streamError_ = e.what();
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streamError_ = "Cannot read stream";
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  finished_ = true;
+  ready_.notify_one();
+}
+
+// Waits until the parser has room for |chunk|. Returns false if the
+// JsonStream is being destroyed instead.
+bool JsonStream::push(std::string &chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  space_.wait(lock, [this] {
+    return stopping_ || chunks_.size() < std::max<size_t>(options_.maxChunks, 1);
+  });
+  if (stopping_) return false;
+  chunks_.push_back(std::move(chunk));
+  ready_.notify_one();
+  return true;
+}
+
+bool JsonStream::stopping() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stopping_;
+}
+
+std::string JsonStream::spare() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spare_.empty()) return std::string();
+  std::string chunk = std::move(spare_.back());
+  spare_.pop_back();
+  return chunk;
+}
+
+// Waits for the next chunk. Returns false at the end of the stream, with
+// error_ filled in if decompression failed.
+bool JsonStream::take(std::string &chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_.wait(lock, [this] { return !chunks_.empty() || finished_; });
+  if (chunks_.empty()) {
+    error_ = streamError_;
+    return false;
+  }
+  chunk = std::move(chunks_.front());
+  chunks_.pop_front();
+  space_.notify_one();
+  return true;
+}
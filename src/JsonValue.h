@@ -5,20 +5,46 @@
 #ifndef LIGHTJSON_JSONVALUE_H
 #define LIGHTJSON_JSONVALUE_H
 
+#include <atomic>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
 #include <variant>
+#include <vector>
 #include "../include/Json.h"
 #include "JsonType.h"
 #include "JsonException.h"
 
 namespace lightjson {
 
+// How a kNumber node stores its value.
+enum class NumberKind {
+  kDouble,
+  kInt64,
+  kUint64,
+  // The text the number was parsed from, see ParseOptions::rawNumbers.
+  kRaw
+};
+
 class JsonValue {
  public:
   virtual ~JsonValue() = default;
 
   virtual bool toBool() const { throw JsonException("Not implemented"); }
   virtual double toDouble() const { throw JsonException("Not implemented"); }
+  virtual NumberKind numberKind() const {
+    throw JsonException("Not implemented");
+  }
+  // The stored value of kInt64, kUint64 and kRaw numbers respectively.
+  virtual int64_t int64Value() const { throw JsonException("Not implemented"); }
+  virtual uint64_t uint64Value() const {
+    throw JsonException("Not implemented");
+  }
+  virtual const std::string &numberText() const {
+    throw JsonException("Not implemented");
+  }
   virtual std::string toString() const { throw JsonException("Not implemented"); }
   virtual Json::array toArray() const { throw JsonException("Not implemented"); }
   virtual Json::object toObject() const { throw JsonException("Not implemented"); }
@@ -33,16 +59,115 @@ class JsonValue {
   virtual const Json &operator[](const std::string &) const {
     throw JsonException("Not implemented");
   }
+  virtual const Json *find(const std::string &) const {
+    throw JsonException("Not implemented");
+  }
+  virtual Json *find(const std::string &) {
+    throw JsonException("Not implemented");
+  }
   virtual size_t size() const noexcept { return -1; }
   virtual JsonType type() const = 0;
+
+  // Direct access to the string and the containers, without the copy
+  // toString()/toArray()/toObject() make.
+  virtual const std::string &stringValue() const {
+    throw JsonException("Not implemented");
+  }
+  virtual std::string &stringValue() { throw JsonException("Not implemented"); }
+  virtual const Json::array &arrayItems() const {
+    throw JsonException("Not implemented");
+  }
+  virtual Json::array &arrayItems() { throw JsonException("Not implemented"); }
+  virtual const Json::object &objectItems() const {
+    throw JsonException("Not implemented");
+  }
+  virtual Json::object &objectItems() {
+    throw JsonException("Not implemented");
+  }
+  // The elements of an array stored packed, see JsonPackedArray. nullptr for
+  // anything else.
+  virtual const std::vector<double> *packedNumbers() const { return nullptr; }
+  virtual const std::vector<uint8_t> *packedBools() const { return nullptr; }
+  bool isPacked() const { return packedNumbers() || packedBools(); }
+
+  // Adds the node and the storage it holds, but not its children, to
+  // |usage|. See Json::memoryUsage().
+  virtual void addMemoryUsage(MemoryUsage &usage) const = 0;
+  // Trims the storage the node holds, but not its children, to its size.
+  virtual void shrink() = 0;
+
+  // Structural hash cache, see Json::hash(). Containers drop it whenever they
+  // are accessed through a non-const accessor, since the caller may be about
+  // to modify them or one of their children.
+  bool hashed() const noexcept { return hashed_; }
+  size_t hash() const noexcept { return hash_; }
+  void setHash(size_t hash) const noexcept {
+    hash_ = hash;
+    hashed_ = true;
+  }
+  void invalidateHash() noexcept { hashed_ = false; }
+
+ private:
+  mutable size_t hash_ = 0;
+  mutable bool hashed_ = false;
 };
 
+// The shared_ptr control block allocated with each node: a vtable pointer
+// and the two reference counts, typically.
+constexpr size_t kControlBlockSize = 2 * sizeof(void *);
+
+// The heap storage of the values nodes hold, and how to trim it.
+template<typename T>
+void addStorage(const T &, MemoryUsage &) {}
+template<typename T>
+void shrinkStorage(T &) {}
+
+inline void addStorage(const std::string &val, MemoryUsage &usage) {
+  // Short strings are held inline, and have this capacity.
+  static const size_t inlineCapacity = std::string().capacity();
+  if (val.capacity() <= inlineCapacity) return;
+  usage.strings += val.capacity() + 1;
+  usage.slack += val.capacity() - val.size();
+}
+
+template<typename T>
+void addStorage(const std::vector<T> &val, MemoryUsage &usage) {
+  usage.containers += val.capacity() * sizeof(T);
+  usage.slack += (val.capacity() - val.size()) * sizeof(T);
+}
+
+inline void addStorage(const Json::object &val, MemoryUsage &usage) {
+  // A bucket is a pointer, an entry holds the member, the pointer to the
+  // next entry and the hash of the key.
+  constexpr size_t entrySize =
+      sizeof(void *) + sizeof(Json::object::value_type) + sizeof(size_t);
+  usage.containers +=
+      val.bucket_count() * sizeof(void *) + val.size() * entrySize;
+  if (val.bucket_count() > val.size())
+    usage.slack += (val.bucket_count() - val.size()) * sizeof(void *);
+  for (const auto &p: val) addStorage(p.first, usage);
+}
+
+inline void shrinkStorage(std::string &val) { val.shrink_to_fit(); }
+
+template<typename T>
+void shrinkStorage(std::vector<T> &val) { val.shrink_to_fit(); }
+
+// The fewest buckets the load factor allows.
+inline void shrinkStorage(Json::object &val) { val.rehash(0); }
+
 template<typename T, JsonType U>
 class Value : public JsonValue {
  public:
   explicit Value(const T &val) : val_(val) {}
-  explicit Value(T &&val) : val_(val) {}
+  explicit Value(T &&val) : val_(std::move(val)) {}
   JsonType type() const final { return U; }
+  // Subclasses add no members, except for JsonPackedArray.
+  void addMemoryUsage(MemoryUsage &usage) const override {
+    usage.nodes[static_cast<size_t>(U)] += sizeof(*this) + kControlBlockSize;
+    addStorage(val_, usage);
+  }
+  void shrink() override { shrinkStorage(val_); }
  protected:
   T val_;
 };
@@ -62,51 +187,197 @@ class JsonDouble : public Value<double, JsonType::kNumber> {
  public:
   explicit JsonDouble(double val) : Value(val) {}
   double toDouble() const override { return val_; }
+  NumberKind numberKind() const override { return NumberKind::kDouble; }
+};
+
+class JsonInt64 : public Value<int64_t, JsonType::kNumber> {
+ public:
+  explicit JsonInt64(int64_t val) : Value(val) {}
+  double toDouble() const override { return static_cast<double>(val_); }
+  NumberKind numberKind() const override { return NumberKind::kInt64; }
+  int64_t int64Value() const override { return val_; }
+};
+
+class JsonUint64 : public Value<uint64_t, JsonType::kNumber> {
+ public:
+  explicit JsonUint64(uint64_t val) : Value(val) {}
+  double toDouble() const override { return static_cast<double>(val_); }
+  NumberKind numberKind() const override { return NumberKind::kUint64; }
+  uint64_t uint64Value() const override { return val_; }
+};
+
+// Converted only when asked for, and serialized as it was written.
+class JsonRawNumber : public Value<std::string, JsonType::kNumber> {
+ public:
+  explicit JsonRawNumber(std::string &&val) : Value(std::move(val)) {}
+  double toDouble() const override { return strtod(val_.c_str(), nullptr); }
+  NumberKind numberKind() const override { return NumberKind::kRaw; }
+  const std::string &numberText() const override { return val_; }
 };
 
 class JsonString : public Value<std::string, JsonType::kString> {
  public:
   explicit JsonString(const std::string &val) : Value(val) {}
-  explicit JsonString(std::string &&val) : Value(val) {}
+  explicit JsonString(std::string &&val) : Value(std::move(val)) {}
   std::string toString() const override { return val_; }
+  const std::string &stringValue() const override { return val_; }
+  std::string &stringValue() override { return val_; }
 };
 
 class JsonArray : public Value<Json::array, JsonType::kArray> {
  public:
   explicit JsonArray(const Json::array &val) : Value(val) {}
-  explicit JsonArray(Json::array &&val) : Value(val) {}
+  explicit JsonArray(Json::array &&val) : Value(std::move(val)) {}
   Json::array toArray() const override { return val_; }
   const Json &operator[](size_t i) const override { return val_[i]; }
-  Json &operator[](size_t i) override { return val_[i]; }
+  Json &operator[](size_t i) override {
+    invalidateHash();
+    return val_[i];
+  }
   size_t size() const noexcept override { return val_.size(); }
+  const Json::array &arrayItems() const override { return val_; }
+  Json::array &arrayItems() override {
+    invalidateHash();
+    return val_;
+  }
+};
+
+// Whether an element of a packed number array is built as an integer, the
+// kind parse() gives integers.
+inline bool isPackedInteger(double val) {
+  return std::abs(val) < 1e15 && val == std::trunc(val)
+      && !(val == 0 && std::signbit(val));
+}
+
+// An array of only numbers or only bools, one T per element instead of a
+// node each. The elements are built as Json on first access through
+// arrayItems() or operator[], once even if several threads read at the same
+// time. Access through the non-const accessors may modify the elements, so
+// from then on they alone hold the array and packed() returns nullptr.
+template<typename T>
+class JsonPackedArray : public Value<std::vector<T>, JsonType::kArray> {
+ public:
+  explicit JsonPackedArray(std::vector<T> &&val)
+      : Value<std::vector<T>, JsonType::kArray>(std::move(val)) {}
+  Json::array toArray() const override { return arrayItems(); }
+  const Json &operator[](size_t i) const override { return arrayItems()[i]; }
+  Json &operator[](size_t i) override { return arrayItems()[i]; }
+  size_t size() const noexcept override {
+    return modified_ ? items_.size() : this->val_.size();
+  }
+  const Json::array &arrayItems() const override {
+    // The elements are hashed before anyone can see them, so that reading
+    // them, e.g. in a JsonSnapshot, never writes to them.
+    std::call_once(unpacked_, [this] {
+      items_.reserve(this->val_.size());
+      for (auto e: this->val_) {
+        items_.push_back(element(e));
+        items_.back().hash();
+      }
+      built_.store(true, std::memory_order_release);
+    });
+    return items_;
+  }
+  Json::array &arrayItems() override {
+    this->invalidateHash();
+    if (!modified_) {
+      static_cast<const JsonPackedArray *>(this)->arrayItems();
+      modified_ = true;
+      std::vector<T>().swap(this->val_);
+    }
+    return items_;
+  }
+  // Once modified, the elements are walked like those of any other array.
+  void addMemoryUsage(MemoryUsage &usage) const override {
+    usage.nodes[static_cast<size_t>(JsonType::kArray)] +=
+        sizeof(*this) + kControlBlockSize;
+    addStorage(this->val_, usage);
+    if (!built_.load(std::memory_order_acquire)) return;
+    addStorage(items_, usage);
+    if (modified_) return;
+    for (auto e: this->val_) addElementUsage(e, usage);
+  }
+  void shrink() override {
+    shrinkStorage(this->val_);
+    shrinkStorage(items_);
+  }
+
+ protected:
+  const std::vector<T> *packed() const {
+    return modified_ ? nullptr : &this->val_;
+  }
+
+ private:
+  mutable std::once_flag unpacked_;
+  mutable Json::array items_;
+  mutable std::atomic<bool> built_{false};
+  bool modified_ = false;
+
+  static Json element(double val) {
+    if (isPackedInteger(val)) return Json(static_cast<int64_t>(val));
+    return Json(val);
+  }
+  static Json element(uint8_t val) { return Json(val != 0); }
+  static void addElementUsage(double val, MemoryUsage &usage) {
+    usage.nodes[static_cast<size_t>(JsonType::kNumber)] += kControlBlockSize
+        + (isPackedInteger(val) ? sizeof(JsonInt64) : sizeof(JsonDouble));
+  }
+  static void addElementUsage(uint8_t, MemoryUsage &usage) {
+    usage.nodes[static_cast<size_t>(JsonType::kBool)] +=
+        sizeof(JsonBool) + kControlBlockSize;
+  }
+};
+
+class JsonPackedNumbers : public JsonPackedArray<double> {
+ public:
+  explicit JsonPackedNumbers(std::vector<double> &&val)
+      : JsonPackedArray(std::move(val)) {}
+  const std::vector<double> *packedNumbers() const override {
+    return packed();
+  }
+};
+
+class JsonPackedBools : public JsonPackedArray<uint8_t> {
+ public:
+  explicit JsonPackedBools(std::vector<uint8_t> &&val)
+      : JsonPackedArray(std::move(val)) {}
+  const std::vector<uint8_t> *packedBools() const override { return packed(); }
 };
 
 class JsonObject : public Value<Json::object, JsonType::kObject> {
  public:
   explicit JsonObject(const Json::object &val) : Value(val) {}
-  explicit JsonObject(Json::object &&val) : Value(val) {}
+  explicit JsonObject(Json::object &&val) : Value(std::move(val)) {}
   Json::object toObject() const override { return val_; }
-  // https://en.cppreference.com/w/cpp/container/unordered_map/operator_at
-  // operator[] is non-const because it inserts the key if it doesn't exist.
-  // If this behavior is undesirable or if the container is const, at() may be
-  // used.
-  const Json &operator[](const std::string &i) const override {
-    try {
-      return val_.at(i);
-    } catch (std::out_of_range &e) {
-      throw JsonException("Key " + i + " does not exist");
-    }
+  // Unlike std::unordered_map, operator[] throws on a missing key instead of
+  // inserting it. find() returns nullptr instead.
+  const Json *find(const std::string &key) const override {
+    auto it = val_.find(key);
+    return it == val_.end() ? nullptr : &it->second;
   }
-  Json &operator[](const std::string &i) override {
-    try {
-      return val_.at(i);
-    } catch (std::out_of_range &e) {
-      throw JsonException("Key " + i + " does not exist");
-    }
+  Json *find(const std::string &key) override {
+    invalidateHash();
+    auto it = val_.find(key);
+    return it == val_.end() ? nullptr : &it->second;
+  }
+  const Json &operator[](const std::string &key) const override {
+    if (const Json *json = find(key)) return *json;
+    throw JsonException("Key " + key + " does not exist");
+  }
+  Json &operator[](const std::string &key) override {
+    if (Json *json = find(key)) return *json;
+    throw JsonException("Key " + key + " does not exist");
   }
   size_t size() const noexcept override { return val_.size(); }
+  const Json::object &objectItems() const override { return val_; }
+  Json::object &objectItems() override {
+    invalidateHash();
+    return val_;
+  }
 };
 
+inline const JsonValue &Json::value() const { return *value_; }
+
 } // namespace
 
 #endif //LIGHTJSON_JSONVALUE_H
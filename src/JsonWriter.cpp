@@ -0,0 +1,179 @@
+#include <cassert>
+#include <cstring>
+#include "../include/JsonWriter.h"
+#include "Dtoa.h"
+
+using namespace ::lightjson;
+
+JsonWriter::JsonWriter(std::string &out, const SerializeOptions &options)
+    : out_(&out), options_(options) {}
+
+JsonWriter::JsonWriter(Sink sink,
+                       size_t bufferSize,
+                       const SerializeOptions &options)
+    : out_(&buffer_),
+      sink_(std::move(sink)),
+      bufferSize_(bufferSize),
+      options_(options) {
+  buffer_.reserve(bufferSize);
+}
+
+JsonWriter &JsonWriter::startObject() {
+  startContainer(true);
+  return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+  endContainer(true);
+  return *this;
+}
+
+JsonWriter &JsonWriter::startArray() {
+  startContainer(false);
+  return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+  endContainer(false);
+  return *this;
+}
+
+JsonWriter &JsonWriter::key(const std::string &key) {
+  return this->key(key.data(), key.size());
+}
+
+JsonWriter &JsonWriter::key(const char *key) {
+  return this->key(key, strlen(key));
+}
+
+JsonWriter &JsonWriter::key(const char *key, size_t size) {
+  assert(!nesting_.empty() && nesting_.top() && "Key outside of an object");
+  assert(!afterKey_ && "Key without a value");
+  if (!first_) *out_ += options_.compact ? "," : ", ";
+  first_ = false;
+  Json::serializeString(key, size, *out_, options_.asciiOnly);
+  *out_ += options_.compact ? ":" : ": ";
+  afterKey_ = true;
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(std::nullptr_t) {
+  beginValue();
+  *out_ += "null";
+  endValue();
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(bool val) {
+  beginValue();
+  *out_ += val ? "true" : "false";
+  endValue();
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(int val) { return integer(int64_t{val}); }
+JsonWriter &JsonWriter::value(long val) {
+  return integer(static_cast<int64_t>(val));
+}
+JsonWriter &JsonWriter::value(long long val) {
+  return integer(static_cast<int64_t>(val));
+}
+JsonWriter &JsonWriter::value(unsigned val) { return integer(uint64_t{val}); }
+JsonWriter &JsonWriter::value(unsigned long val) {
+  return integer(static_cast<uint64_t>(val));
+}
+JsonWriter &JsonWriter::value(unsigned long long val) {
+  return integer(static_cast<uint64_t>(val));
+}
+
+JsonWriter &JsonWriter::value(double val) {
+  beginValue();
+  char buf[kDoubleBufferSize];
+  out_->append(buf, formatDouble(buf, val));
+  endValue();
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(const std::string &val) {
+  return value(val.data(), val.size());
+}
+
+JsonWriter &JsonWriter::value(const char *val) {
+  return value(val, strlen(val));
+}
+
+JsonWriter &JsonWriter::value(const char *val, size_t size) {
+  beginValue();
+  Json::serializeString(val, size, *out_, options_.asciiOnly);
+  endValue();
+  return *this;
+}
+
+JsonWriter &JsonWriter::value(const Json &val) {
+  beginValue();
+  val.serialize(*out_, options_);
+  endValue();
+  return *this;
+}
+
+void JsonWriter::flush() {
+  if (!sink_ || buffer_.empty()) return;
+  sink_(buffer_.data(), buffer_.size());
+  buffer_.clear();
+}
+
+void JsonWriter::beginValue() {
+  if (nesting_.empty()) {
+    assert(!done_ && "More than one root value");
+    return;
+  }
+  if (nesting_.top()) {
+    assert(afterKey_ && "Value without a key");
+    afterKey_ = false;
+    return;
+  }
+  if (!first_) *out_ += options_.compact ? "," : ", ";
+  first_ = false;
+}
+
+void JsonWriter::endValue() {
+  if (nesting_.empty()) {
+    done_ = true;
+    flush();
+  } else if (sink_ && buffer_.size() >= bufferSize_) {
+    flush();
+  }
+}
+
+void JsonWriter::startContainer(bool isObject) {
+  beginValue();
+  *out_ += isObject ? '{' : '[';
+  nesting_.push(isObject);
+  first_ = true;
+}
+
+void JsonWriter::endContainer(bool isObject) {
+  assert(!nesting_.empty() && nesting_.top() == isObject
+             && "End without a matching start");
+  assert(!afterKey_ && "Key without a value");
+  *out_ += isObject ? '}' : ']';
+  nesting_.pop();
+  first_ = false;
+  endValue();
+}
+
+JsonWriter &JsonWriter::integer(int64_t val) {
+  beginValue();
+  char buf[kDoubleBufferSize];
+  out_->append(buf, formatInteger(buf, val));
+  endValue();
+  return *this;
+}
+
+JsonWriter &JsonWriter::integer(uint64_t val) {
+  beginValue();
+  char buf[kDoubleBufferSize];
+  out_->append(buf, formatInteger(buf, val));
+  endValue();
+  return *this;
+}
@@ -0,0 +1,52 @@
+#include <unordered_set>
+#include <vector>
+#include "../include/Json.h"
+#include "JsonValue.h"
+
+using namespace ::lightjson;
+
+size_t MemoryUsage::total() const {
+  size_t total = containers + strings;
+  for (auto bytes: nodes) total += bytes;
+  return total;
+}
+
+MemoryUsage Json::memoryUsage() const {
+  MemoryUsage usage;
+  std::unordered_set<const JsonValue *> seen;
+  std::vector<const Json *> stack{this};
+  while (!stack.empty()) {
+    const auto &value = stack.back()->value();
+    stack.pop_back();
+    if (!seen.insert(&value).second) continue;
+    value.addMemoryUsage(usage);
+    // Packed arrays count their elements themselves.
+    if (value.isPacked()) continue;
+    if (value.type() == JsonType::kArray) {
+      for (const auto &e: value.arrayItems()) stack.push_back(&e);
+    } else if (value.type() == JsonType::kObject) {
+      for (const auto &p: value.objectItems()) stack.push_back(&p.second);
+    }
+  }
+  return usage;
+}
+
+// Goes through the const accessors, since trimming does not change any value
+// and so keeps the hashes cached.
+void Json::shrink() {
+  std::vector<const Json *> stack{this};
+  while (!stack.empty()) {
+    const auto &node = stack.back()->value_;
+    stack.pop_back();
+    // Everything below a shared node is shared as well.
+    if (node.use_count() != 1) continue;
+    node->shrink();
+    const JsonValue &value = *node;
+    if (value.isPacked()) continue;
+    if (value.type() == JsonType::kArray) {
+      for (const auto &e: value.arrayItems()) stack.push_back(&e);
+    } else if (value.type() == JsonType::kObject) {
+      for (const auto &p: value.objectItems()) stack.push_back(&p.second);
+    }
+  }
+}
@@ -0,0 +1,56 @@
+#include <new>
+#include "NodePool.h"
+
+using namespace ::lightjson;
+
+NodePool::NodePool() : refs_(1) {
+  for (size_t i = 0; i != kClasses; ++i) {
+    local_[i] = nullptr;
+    returned_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+NodePool::~NodePool() {
+  for (size_t i = 0; i != kClasses; ++i) {
+    for (Block *b = local_[i]; b;) {
+      Block *next = b->next;
+      ::operator delete(b);
+      b = next;
+    }
+    for (Block *b = returned_[i].load(std::memory_order_acquire); b;) {
+      Block *next = b->next;
+      ::operator delete(b);
+      b = next;
+    }
+  }
+}
+
+void *NodePool::allocate(size_t size) {
+  const size_t index = (size - 1) / kGranularity;
+  if (index >= kClasses) return ::operator new(size);
+  refs_.fetch_add(1, std::memory_order_relaxed);
+  Block *b = local_[index];
+  if (!b) b = returned_[index].exchange(nullptr, std::memory_order_acquire);
+  if (!b) return ::operator new((index + 1) * kGranularity);
+  local_[index] = b->next;
+  return b;
+}
+
+void NodePool::deallocate(void *p, size_t size) noexcept {
+  const size_t index = (size - 1) / kGranularity;
+  if (index >= kClasses) {
+    ::operator delete(p);
+    return;
+  }
+  // Only the owner ever takes blocks off this list, and it takes all of them
+  // at once, so a plain CAS push is safe from ABA.
+  auto b = static_cast<Block *>(p);
+  b->next = returned_[index].load(std::memory_order_relaxed);
+  while (!returned_[index].compare_exchange_weak(
+      b->next, b, std::memory_order_release, std::memory_order_relaxed));
+  unref();
+}
+
+void NodePool::unref() noexcept {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+}
@@ -0,0 +1,74 @@
+#ifndef LIGHTJSON_NODEPOOL_H
+#define LIGHTJSON_NODEPOOL_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace lightjson {
+
+// Free lists of node-sized blocks behind a ParserContext. Blocks are only
+// taken by the thread that owns the context, but nodes may die on any thread,
+// so blocks come back through a lock-free list that the owner drains when its
+// own list runs dry. The pool counts the live blocks and deletes itself once
+// the context and all of its nodes are gone.
+class NodePool {
+ public:
+  static NodePool *create() { return new NodePool(); }
+  // Drops the context's reference.
+  void release() { unref(); }
+
+  void *allocate(size_t);
+  void deallocate(void *, size_t) noexcept;
+
+ private:
+  struct Block {
+    Block *next;
+  };
+  // 16 byte classes up to 256 bytes, which fits every node with its control
+  // block. Anything bigger goes to operator new.
+  static constexpr size_t kGranularity = 16;
+  static constexpr size_t kClasses = 16;
+
+  NodePool();
+  ~NodePool();
+  void unref() noexcept;
+
+  Block *local_[kClasses];
+  std::atomic<Block *> returned_[kClasses];
+  std::atomic<size_t> refs_;
+};
+
+// Allocator for std::allocate_shared, see Parser::make().
+template<typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  explicit PoolAllocator(NodePool *pool) noexcept : pool_(pool) {}
+  template<typename U>
+  PoolAllocator(const PoolAllocator<U> &o) noexcept : pool_(o.pool_) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(pool_->allocate(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t n) noexcept {
+    pool_->deallocate(p, n * sizeof(T));
+  }
+
+  template<typename U>
+  bool operator==(const PoolAllocator<U> &o) const noexcept {
+    return pool_ == o.pool_;
+  }
+  template<typename U>
+  bool operator!=(const PoolAllocator<U> &o) const noexcept {
+    return pool_ != o.pool_;
+  }
+
+ private:
+  template<typename U> friend class PoolAllocator;
+  NodePool *pool_;
+};
+
+} // namespace
+
+#endif //LIGHTJSON_NODEPOOL_H
@@ -0,0 +1,74 @@
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include "Number.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+CanonicalNumber makeInteger(bool negative, uint64_t magnitude) {
+  return {true, negative && magnitude != 0, magnitude, 0};
+}
+
+} // namespace
+
+CanonicalNumber lightjson::canonicalNumber(double value) {
+  // 2^64. Integral doubles below it in magnitude convert exactly.
+  constexpr double kLimit = 18446744073709551616.0;
+  if (std::trunc(value) == value && std::abs(value) < kLimit)
+    return makeInteger(value < 0, static_cast<uint64_t>(std::abs(value)));
+  return {false, false, 0, value};
+}
+
+CanonicalNumber lightjson::canonicalNumber(int64_t value) {
+  // Negate in unsigned arithmetic, so that INT64_MIN does not overflow.
+  const auto bits = static_cast<uint64_t>(value);
+  return makeInteger(value < 0, value < 0 ? 0 - bits : bits);
+}
+
+CanonicalNumber lightjson::canonicalNumber(uint64_t value) {
+  return makeInteger(false, value);
+}
+
+CanonicalNumber lightjson::canonicalNumber(const char *begin,
+                                           const char *end) {
+  const char *digits = begin + (*begin == '-');
+  const char *p = digits;
+  while (p != end && '0' <= *p && *p <= '9') ++p;
+  uint64_t magnitude;
+  if (p == end && readUint64(digits, end, magnitude))
+    return makeInteger(*begin == '-', magnitude);
+  // The text is not null-terminated, and strtod would read past |end|.
+  return canonicalNumber(std::strtod(std::string(begin, end).c_str(),
+                                     nullptr));
+}
+
+bool lightjson::readUint64(const char *begin, const char *end, uint64_t &out) {
+  constexpr uint64_t kMax = std::numeric_limits<uint64_t>::max();
+  uint64_t n = 0;
+  for (const char *p = begin; p != end; ++p) {
+    const auto digit = static_cast<uint64_t>(*p - '0');
+    if (n > (kMax - digit) / 10) return false;
+    n = n * 10 + digit;
+  }
+  out = n;
+  return true;
+}
+
+bool lightjson::toInt64(const CanonicalNumber &number, int64_t &out) {
+  if (!number.isInteger) return false;
+  constexpr auto kMax =
+      static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+  if (number.magnitude > kMax + number.negative) return false;
+  out = static_cast<int64_t>(number.negative ? 0 - number.magnitude
+                                             : number.magnitude);
+  return true;
+}
+
+bool lightjson::toUint64(const CanonicalNumber &number, uint64_t &out) {
+  if (!number.isInteger || number.negative) return false;
+  out = number.magnitude;
+  return true;
+}
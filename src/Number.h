@@ -0,0 +1,44 @@
+#ifndef LIGHTJSON_NUMBER_H
+#define LIGHTJSON_NUMBER_H
+
+#include <cstdint>
+
+namespace lightjson {
+
+// A number by its mathematical value, whatever kind of node stores it: an
+// integer if it is one and its magnitude fits in 64 bits, a double otherwise.
+// Numbers are equal exactly when their canonical forms are, and hash through
+// them.
+struct CanonicalNumber {
+  bool isInteger;
+  // Integers only. Zero is never negative.
+  bool negative;
+  uint64_t magnitude;
+  // Everything else: fractions, NaN, infinities, and integers too large for
+  // |magnitude|.
+  double value;
+
+  bool operator==(const CanonicalNumber &o) const {
+    if (isInteger != o.isInteger) return false;
+    if (isInteger) return negative == o.negative && magnitude == o.magnitude;
+    return value == o.value;
+  }
+};
+
+CanonicalNumber canonicalNumber(double);
+CanonicalNumber canonicalNumber(int64_t);
+CanonicalNumber canonicalNumber(uint64_t);
+// |begin| to |end| must be a valid JSON number.
+CanonicalNumber canonicalNumber(const char *begin, const char *end);
+
+// Reads the digits from |begin| to |end| into |out|. Returns false if the
+// value does not fit.
+bool readUint64(const char *begin, const char *end, uint64_t &out);
+
+// Whether the canonical number converts to the type exactly.
+bool toInt64(const CanonicalNumber &, int64_t &);
+bool toUint64(const CanonicalNumber &, uint64_t &);
+
+} // namespace
+
+#endif //LIGHTJSON_NUMBER_H
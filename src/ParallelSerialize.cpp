@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/Json.h"
+#include "JsonValue.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+// Containers with fewer elements are not worth splitting.
+constexpr size_t kMinParallelItems = 1024;
+// Several chunks per thread, so that elements of uneven size still balance.
+constexpr size_t kChunksPerThread = 4;
+// How far below the root to look for large containers, e.g. the "rows" of
+// {"rows": [...]}.
+constexpr size_t kMaxParallelDepth = 4;
+
+} // namespace
+
+// The output of one serialize() call, split up before any thread starts: the
+// text around the large containers, written on the calling thread, and the
+// chunks of their elements, written by one set of workers for the whole
+// document. Text before the first chunk goes straight to the output.
+class lightjson::SerializePlan {
+ public:
+  using Write = std::function<void(size_t, std::string &)>;
+
+  SerializePlan(std::string &out, unsigned threads)
+      : out_(&out), threads_(threads) {}
+
+  // Where the text before the next chunk goes.
+  std::string &text() {
+    if (chunks_.empty()) return *out_;
+    if (pieces_.back().write) pieces_.emplace_back();
+    return pieces_.back().text;
+  }
+
+  // Splits elements 0 to |count| - 1 into chunks, each written by |write|.
+  void addChunks(size_t count, Write write) {
+    writers_.push_back(std::move(write));
+    const size_t chunks = std::min<size_t>(threads_ * kChunksPerThread, count);
+    for (size_t chunk = 0; chunk != chunks; ++chunk) {
+      chunks_.push_back(pieces_.size());
+      pieces_.emplace_back();
+      auto &piece = pieces_.back();
+      piece.write = &writers_.back();
+      piece.begin = count * chunk / chunks;
+      piece.end = count * (chunk + 1) / chunks;
+    }
+  }
+
+  // Keeps |members| alive until the chunks that refer to them are written.
+  std::vector<const Json::object::value_type *> &addMembers() {
+    members_.emplace_back();
+    return members_.back();
+  }
+
+  // Appends the rest of the pieces to the output in order. A chunk is appended and freed as
+  // soon as it and the pieces before it are done, so that at most a few are
+  // held at once unless one is slow. What a worker throws is rethrown here,
+  // once every worker has stopped.
+  void write();
+
+ private:
+  struct Piece {
+    std::string text;
+    // Set for chunks, which are written into |text| by a worker.
+    const Write *write = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    bool done = false;
+    std::exception_ptr error;
+  };
+
+  std::string *const out_;
+  const unsigned threads_;
+  std::vector<Piece> pieces_;
+  // Indexes of the chunks in pieces_, in the order workers take them.
+  std::vector<size_t> chunks_;
+  // Deques, so that what chunks point into never moves.
+  std::deque<Write> writers_;
+  std::deque<std::vector<const Json::object::value_type *>> members_;
+  std::atomic<size_t> next_{0};
+  std::atomic<bool> stopping_{false};
+  std::mutex mutex_;
+  std::condition_variable ready_;
+
+  void work();
+};
+
+void SerializePlan::write() {
+  std::vector<std::thread> workers;
+  std::exception_ptr error;
+  try {
+    const auto count = std::min<size_t>(threads_, chunks_.size());
+    workers.reserve(count);
+    for (size_t i = 0; i != count; ++i)
+      workers.emplace_back(&SerializePlan::work, this);
+    for (auto &piece: pieces_) {
+      std::string text;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&piece] { return !piece.write || piece.done; });
+        if (piece.error) std::rethrow_exception(piece.error);
+        text = std::move(piece.text);
+      }
+      *out_ += text;
+    }
+  } catch (...) {
+    error = std::current_exception();
+    stopping_ = true;
+  }
+  for (auto &worker: workers) worker.join();
+  if (error) std::rethrow_exception(error);
+}
+
+void SerializePlan::work() {
+  for (size_t i; !stopping_ && (i = next_++) < chunks_.size();) {
+    auto &piece = pieces_[chunks_[i]];
+    std::string buffer;
+    std::exception_ptr error;
+    try {
+      for (size_t j = piece.begin; j != piece.end; ++j)
+        (*piece.write)(j, buffer);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    piece.text = std::move(buffer);
+    piece.error = error;
+    piece.done = true;
+    ready_.notify_one();
+  }
+}
+
+void Json::serializeParallel(std::string &out,
+                             const SerializeOptions &options,
+                             unsigned threads) const {
+  SerializePlan plan(out, threads);
+  planParallel(plan, options, 0);
+  plan.write();
+}
+
+// Writes the same text as serializeTree(). Large containers are chunked, the
+// containers in small ones are looked into in turn.
+void Json::planParallel(SerializePlan &plan,
+                        const SerializeOptions &options,
+                        size_t depth) const {
+  const auto &value = this->value();
+  const auto type = value.type();
+  if ((type != JsonType::kArray && type != JsonType::kObject)
+      || value.size() == 0 || value.isPacked()
+      || depth == kMaxParallelDepth) {
+    serializeTree(plan.text(), options);
+    return;
+  }
+  const char *comma = options.compact ? "," : ", ";
+  const char *colon = options.compact ? ":" : ": ";
+  if (type == JsonType::kArray) {
+    const auto &arr = value.arrayItems();
+    plan.text() += '[';
+    if (arr.size() >= kMinParallelItems) {
+      plan.addChunks(arr.size(),
+                     [&arr, &options, comma](size_t i, std::string &buffer) {
+                       if (i) buffer += comma;
+                       arr[i].serializeTree(buffer, options);
+                     });
+    } else {
+      for (size_t i = 0; i != arr.size(); ++i) {
+        if (i) plan.text() += comma;
+        arr[i].planParallel(plan, options, depth + 1);
+      }
+    }
+    plan.text() += ']';
+    return;
+  }
+  const auto &obj = value.objectItems();
+  plan.text() += '{';
+  if (obj.size() >= kMinParallelItems) {
+    // Members in iteration order, which is the order serializeTree() writes.
+    auto &members = plan.addMembers();
+    members.reserve(obj.size());
+    for (const auto &p: obj) members.push_back(&p);
+    plan.addChunks(members.size(),
+                   [&members, &options, comma, colon](size_t i,
+                                                      std::string &buffer) {
+                     if (i) buffer += comma;
+                     serializeString(members[i]->first, buffer,
+                                     options.asciiOnly);
+                     buffer += colon;
+                     members[i]->second.serializeTree(buffer, options);
+                   });
+  } else {
+    bool first = true;
+    for (const auto &p: obj) {
+      if (!first) plan.text() += comma;
+      first = false;
+      serializeString(p.first, plan.text(), options.asciiOnly);
+      plan.text() += colon;
+      p.second.planParallel(plan, options, depth + 1);
+    }
+  }
+  plan.text() += '}';
+}
@@ -0,0 +1,94 @@
+#include <functional>
+#include <iterator>
+#include "../include/ParseCache.h"
+
+using namespace ::lightjson;
+
+namespace {
+
+// Besides the Entry: the links of its list node, its hash table node (next,
+// key, iterator, cached hash) and a bucket.
+constexpr size_t kEntryOverhead = 7 * sizeof(void *);
+
+} // namespace
+
+ParseCache::ParseCache(size_t budget, const ParseOptions &options)
+    : budget_(budget), options_(options) {}
+
+JsonSnapshot::Ptr ParseCache::parse(const std::string &text,
+                                    std::string &error) {
+  const size_t hash = std::hash<std::string>()(text);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto json = findLocked(hash, text)) {
+      ++stats_.hits;
+      return json;
+    }
+    ++stats_.misses;
+  }
+  std::string parseError;
+  Json json = Json::parse(text, parseError, options_);
+  if (!parseError.empty()) {
+    error = parseError;
+    return nullptr;
+  }
+  const size_t bytes = sizeof(Entry) + kEntryOverhead + text.size()
+      + json.memoryUsage().total();
+  auto snapshot = JsonSnapshot::create(std::move(json));
+  if (bytes > budget_) return snapshot;
+  // Evicted documents are destroyed after the lock is released, so that
+  // other threads don't wait for their trees to be torn down.
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Another thread may have parsed the same text meanwhile.
+  if (auto cached = findLocked(hash, text)) return cached;
+  entries_.push_front(Entry{hash, text, snapshot, bytes});
+  index_.emplace(hash, entries_.begin());
+  stats_.bytes += bytes;
+  ++stats_.entries;
+  while (stats_.bytes > budget_) evictLocked(evicted);
+  return snapshot;
+}
+
+ParseCacheStats ParseCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void ParseCache::clear() {
+  std::list<Entry> evicted;
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  evicted.swap(entries_);
+  stats_.bytes = 0;
+  stats_.entries = 0;
+}
+
+// Returns the document parsed from |text|, and marks it as the most recently
+// used one, or nullptr if it is not cached.
+JsonSnapshot::Ptr ParseCache::findLocked(size_t hash,
+                                         const std::string &text) {
+  const auto range = index_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second->text != text) continue;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->json;
+  }
+  return nullptr;
+}
+
+// Moves the least recently used entry to |evicted|.
+void ParseCache::evictLocked(std::list<Entry> &evicted) {
+  const auto last = std::prev(entries_.end());
+  const auto range = index_.equal_range(last->hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == last) {
+      index_.erase(it);
+      break;
+    }
+  }
+  stats_.bytes -= last->bytes;
+  --stats_.entries;
+  ++stats_.evictions;
+  evicted.splice(evicted.end(), entries_, last);
+}
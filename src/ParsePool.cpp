@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <numeric>
+#include "../include/ParsePool.h"
+#include "../include/ParserContext.h"
+
+using namespace ::lightjson;
+
+struct ParsePool::Worker {
+  std::mutex mutex;
+  // Largest first, both for the owner and for thieves.
+  std::deque<Task> tasks;
+  ParserContext context;
+  std::thread thread;
+};
+
+ParsePool::ParsePool(unsigned threads, const ParseOptions &options)
+    : options_(options) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned i = 0; i != threads; ++i)
+    workers_.emplace_back(new Worker());
+  for (size_t i = 0; i != workers_.size(); ++i)
+    workers_[i]->thread = std::thread(&ParsePool::run, this, i);
+}
+
+ParsePool::~ParsePool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker: workers_) worker->thread.join();
+}
+
+std::vector<std::future<ParseResult>> ParsePool::parse(
+    const std::vector<std::string> &texts) {
+  auto promises =
+      std::make_shared<std::vector<std::promise<ParseResult>>>(texts.size());
+  std::vector<std::future<ParseResult>> futures;
+  futures.reserve(texts.size());
+  for (auto &promise: *promises) futures.push_back(promise.get_future());
+  submit(texts, [&promises](size_t i) {
+    return [promises, i](ParseResult &&result) {
+      (*promises)[i].set_value(std::move(result));
+    };
+  });
+  return futures;
+}
+
+void ParsePool::parse(const std::vector<std::string> &texts, Callback done) {
+  auto shared = std::make_shared<Callback>(std::move(done));
+  submit(texts, [&shared](size_t i) {
+    return [shared, i](ParseResult &&result) {
+      (*shared)(i, std::move(result));
+    };
+  });
+}
+
+void ParsePool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return unfinished_ == 0; });
+}
+
+// Deals the texts out round-robin, largest first, so that big documents
+// start early and are spread over the threads.
+void ParsePool::submit(
+    const std::vector<std::string> &texts,
+    const std::function<std::function<void(ParseResult &&)>(size_t)>
+    &makeDone) {
+  if (texts.empty()) return;
+  std::vector<size_t> order(texts.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&texts](size_t a, size_t b) {
+    return texts[a].size() > texts[b].size();
+  });
+  // Counted before they can be taken, so that the count never drops below
+  // the tasks still to run.
+  unfinished_ += texts.size();
+  for (size_t i = 0; i != order.size(); ++i) {
+    auto &worker = *workers_[i % workers_.size()];
+    Task task{&texts[order[i]], makeDone(order[i])};
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+    ++queued_;
+  }
+  // An idle thread checks queued_ under mutex_ before it waits, so taking it
+  // here makes sure none is between the two and misses the wakeup.
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  wake_.notify_all();
+}
+
+void ParsePool::run(size_t self) {
+  auto &worker = *workers_[self];
+  Task task;
+  for (;;) {
+    if (!take(self, task)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return queued_ || stopping_; });
+      if (stopping_ && !queued_) return;
+      // Another thread may take the task first, then take() looks again.
+      continue;
+    }
+    ParseResult result;
+    result.json = worker.context.parse(*task.text, result.error, options_);
+    task.done(std::move(result));
+    task.done = nullptr;
+    if (--unfinished_ == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      idle_.notify_all();
+    }
+  }
+}
+
+// Takes a task from the worker's own queue, or else steals one from the
+// others, starting with the next worker over. queued_ changes under the lock
+// of the queue it counts, so it is only non-zero for a moment longer than
+// the queues hold a task.
+bool ParsePool::take(size_t self, Task &task) {
+  for (size_t i = 0; i != workers_.size(); ++i) {
+    auto &worker = *workers_[(self + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) continue;
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    --queued_;
+    return true;
+  }
+  return false;
+}
@@ -4,129 +4,327 @@
 
 #include <cstring>
 #include <cmath>
-#include <locale>
-#include <codecvt>
-#include <sstream>
+#include <limits>
 #include "Parser.h"
+#include "Grammar.h"
+#include "Number.h"
+#include "StringScan.h"
+#include "Utf8.h"
 
 using namespace ::lightjson;
 
-constexpr bool isDigit(const char *ch) { return '0' <= *ch && *ch <= '9'; }
-constexpr bool isDigit1to9(const char *ch) { return '1' <= *ch && *ch <= '9'; }
-
 Json Parser::parse() {
+  Interner interner;
+  if (options_.deduplicate) interner_ = &interner;
+  projection_ = options_.projection ? 0 : Projection::kAll;
+  if (options_.strictUtf8 && !isValidUtf8(curr_, end_)) {
+    curr_ = findInvalidUtf8(curr_, end_);
+    error("Invalid UTF-8");
+  }
   parseWhiteSpace();
-  auto json = parseValue();
+  auto json = dedup(parseValue());
   parseWhiteSpace();
   if (*curr_)
     error("Root not singular");
   return json;
 }
 
+// Containers are parsed without recursion, so that deep documents can't
+// overflow the stack: the outer loop parses one value or opens a container,
+// the inner loop adds the value to the innermost open container and closes
+// the containers that end right after it.
 Json Parser::parseValue() {
-  switch (*curr_) {
-    case 'n': return parseLiteral("null");
-    case 't': return parseLiteral("true");
-    case 'f': return parseLiteral("false");
-    case '\"': return parseString();
-    case '[': return parseArray();
-    case '{': return parseObject();
-    case '\0': error("Expect value");
-    default: return parseNumber();
+  auto &frames = context_ ? context_->frames_ : ownFrames_;
+  Json value{std::shared_ptr<JsonValue>()};
+  using Packing = ParserContext::Frame::Packing;
+  for (;;) {
+    if (depth_ && frames[depth_ - 1].packing != Packing::kNone
+        && packElement(frames[depth_ - 1])) {
+      value.value_.reset();
+    } else {
+      switch (*curr_) {
+        case 'n': {
+          value = parseLiteral("null", 4);
+          break;
+        }
+        case 't': {
+          value = parseLiteral("true", 4);
+          break;
+        }
+        case 'f': {
+          value = parseLiteral("false", 5);
+          break;
+        }
+        case '\"': {
+          value = parseString();
+          break;
+        }
+        case '[':
+        case '{': {
+          const bool isObject = *curr_ == '{';
+          if (depth_ == options_.maxDepth) error("Exceed maximum depth");
+          curr_++;
+          if (depth_ == frames.size()) frames.emplace_back();
+          auto &frame = frames[depth_];
+          frame.isObject = isObject;
+          frame.projection = projection_;
+          frame.packing = !isObject && options_.packArrays
+              && !options_.rawNumbers ? Packing::kEmpty : Packing::kNone;
+          frame.numbers.clear();
+          frame.bools.clear();
+          if (isObject)
+            frame.object =
+                context_ ? context_->takeObject(depth_) : Json::object();
+          else
+            frame.array = context_ ? context_->takeArray(depth_) : Json::array();
+          ++depth_;
+          parseWhiteSpace();
+          if (*curr_ != (isObject ? '}' : ']')
+              && (!isObject || nextMember(frame)))
+            continue;
+          if (*curr_ != (isObject ? '}' : ']'))
+            error("Missing closing bracket or comma");
+          curr_++;
+          value = closeContainer(frame);
+          break;
+        }
+        case '\0': error("Expect value");
+        default: value = parseNumber();
+      }
+    }
+    for (;;) {
+      if (depth_ == 0) return value;
+      auto &frame = frames[depth_ - 1];
+      if (!value.value_) {
+        // Already stored packed.
+      } else if (frame.isObject) {
+        // The last of duplicate keys wins.
+        auto it = frame.object.find(frame.key);
+        if (it == frame.object.end())
+          frame.object.emplace(frame.key, dedup(std::move(value)));
+        else it->second = dedup(std::move(value));
+      } else {
+        frame.array.push_back(dedup(std::move(value)));
+      }
+      parseWhiteSpace();
+      if (*curr_ == ',') {
+        curr_++;
+        parseWhiteSpace();
+        if (!frame.isObject) {
+          projection_ = frame.projection;
+          break;
+        }
+        if (nextMember(frame)) break;
+      }
+      if (*curr_ != (frame.isObject ? '}' : ']'))
+        error("Missing closing bracket or comma");
+      curr_++;
+      value = closeContainer(frame);
+    }
   }
 }
 
-Json Parser::parseLiteral(const std::string &literal) {
-  if (strncmp(curr_, literal.c_str(), literal.size()) != 0) {
+Json Parser::parseLiteral(const char *literal, size_t size) {
+  if (strncmp(curr_, literal, size) != 0) {
     error("Invalid value");
   }
-  curr_ += literal.size();
-  if (literal[0] == 't') return Json(true);
-  if (literal[0] == 'f') return Json(false);
-  return Json(nullptr);
+  curr_ += size;
+  if (literal[0] == 't') return make<JsonBool>(true);
+  if (literal[0] == 'f') return make<JsonBool>(false);
+  return make<JsonNull>(nullptr);
 }
 
 Json Parser::parseNumber() {
   const char *start = curr_;
-  // Manually check if the number is valid, and move |curr| to the end.
-  if (*curr_ == '-') ++curr_;
-  // if 0 leads, the number must have a decimal component.
-  if (*curr_ == '0') ++curr_;
-  else {
-    // else, leading digit cannot be 0 (or anything else).
-    if (!isDigit1to9(curr_)) error("Invalid value");
-    while (isDigit(++curr_));
-  }
-  if (*curr_ == '.') {
-    if (!isDigit(++curr_)) error("Invalid value");
-    while (isDigit(++curr_));
-  }
-  if (*curr_ == 'e' || *curr_ == 'E') {
-    ++curr_;
-    // +- sign after exponent is optional.
-    if (*curr_ == '+' || *curr_ == '-') ++curr_;
-    if (!isDigit(curr_)) error("Invalid value");
-    while (isDigit(++curr_));
+  const char *digitsEnd = scanNumber();
+  if (options_.rawNumbers)
+    return make<JsonRawNumber>(std::string(start, curr_));
+  // Integers are kept exact if they fit. Only -0 needs a double for its sign.
+  const bool negative = *start == '-';
+  uint64_t magnitude;
+  if (curr_ == digitsEnd
+      && readUint64(start + negative, curr_, magnitude)
+      && !(negative && magnitude == 0)) {
+    constexpr auto kInt64Max =
+        static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    if (negative) {
+      if (magnitude <= kInt64Max + 1)
+        return make<JsonInt64>(static_cast<int64_t>(0 - magnitude));
+    } else if (magnitude <= kInt64Max) {
+      return make<JsonInt64>(static_cast<int64_t>(magnitude));
+    } else {
+      return make<JsonUint64>(magnitude);
+    }
   }
   auto val = strtod(start, nullptr);
   if (std::abs(val) == HUGE_VAL)
     error("Number out of bound");
-  return Json(val);
+  return make<JsonDouble>(val);
+}
+
+// Checks the number at |curr_| and moves past it. Returns where its integer
+// part ends.
+const char *Parser::scanNumber() {
+  const char *digitsEnd = nullptr;
+  if (!lightjson::scanNumber(curr_, digitsEnd)) error("Invalid value");
+  return digitsEnd;
 }
 
 Json Parser::parseString() {
-  return Json(parseRawString());
+  const auto &str = parseRawString();
+  if (context_) return make<JsonString>(context_->takeString(str));
+  return make<JsonString>(str);
 }
 
-Json Parser::parseArray() {
-  Json::array arr;
-  curr_++;
+void Parser::parseKey(std::string &key) {
+  if (*curr_ != '"') error("Missing key");
+  key.clear();
+  parseRawString(key);
   parseWhiteSpace();
-  if (*curr_ == ']') {
-    curr_++;
-    return Json(arr);
-  }
+  if (*curr_++ != ':')
+    error("Missing colon");
+  parseWhiteSpace();
+}
+
+// Parses keys up to the next member that is projected, skipping the others.
+// Returns false if there is none left, in which case |curr_| should be at the
+// closing bracket.
+bool Parser::nextMember(ParserContext::Frame &frame) {
   for (;;) {
+    parseKey(frame.key);
+    if (!options_.projection) return true;
+    projection_ = options_.projection->member(frame.projection, frame.key);
+    if (projection_ != Projection::kSkip) return true;
+    skipValue();
     parseWhiteSpace();
-    arr.push_back(parseValue());
+    if (*curr_ != ',') return false;
+    curr_++;
     parseWhiteSpace();
-    if (*curr_ == ',')
-      curr_++;
-    else if (*curr_ == ']') {
-      curr_++;
-      return Json(arr);
-    } else
-      error("Missing closing bracket or comma");
   }
 }
 
-Json Parser::parseObject() {
-  Json::object obj;
-  curr_++;
-  parseWhiteSpace();
-  if (*curr_ == '}') {
-    curr_++;
-    return Json(obj);
+// Moves past the value at |curr_| without decoding it. Only brackets and
+// strings are looked at, to find where the value ends.
+void Parser::skipValue() {
+  const char *const start = curr_;
+  size_t depth = 0;
+  for (;;) {
+    if (depth) curr_ = skipToBracketOrQuote(curr_, end_);
+    const char ch = *curr_;
+    if (ch == '"') {
+      skipString();
+      if (depth == 0) return;
+      continue;
+    }
+    if (ch == '[' || ch == '{') {
+      ++depth;
+    } else if (ch == ']' || ch == '}') {
+      if (depth == 0) break;
+      if (--depth == 0) {
+        ++curr_;
+        return;
+      }
+    } else if (curr_ == end_) {
+      if (depth) error("Missing closing bracket or comma");
+      break;
+    } else if (depth == 0 && (ch == ',' || ch == ' ' || ch == '\t'
+        || ch == '\n' || ch == '\r')) {
+      break;
+    }
+    ++curr_;
   }
+  if (curr_ == start) error(*curr_ ? "Invalid value" : "Expect value");
+}
+
+// Moves past the string at |curr_|, escapes and all.
+void Parser::skipString() {
+  const char *p = curr_ + 1;
   for (;;) {
-    parseWhiteSpace();
-    if (*curr_ != '"') error("Missing key");
-    auto key = parseRawString();
-    parseWhiteSpace();
-    if (*curr_++ != ':')
-      error("Missing colon");
-    parseWhiteSpace();
-    auto val = parseValue();
-    obj[key] = val;
-    parseWhiteSpace();
-    if (*curr_ == ',')
-      curr_++;
-    else if (*curr_ == '}') {
-      curr_++;
-      return Json(obj);
-    } else
-      error("Missing closing bracket or comma");
+    p = skipUnescaped(p, end_);
+    if (p == end_) {
+      curr_ = p;
+      error("Missing quotation mark");
+    }
+    if (*p == '"') break;
+    // Control characters are let through, like everything else skipped.
+    p += *p == '\\' && p + 1 != end_ ? 2 : 1;
+  }
+  curr_ = p + 1;
+}
+
+// Stores the element at |curr_| in the packed array being read, if it is of
+// the array's kind and packs without changing how it is written back. Else
+// moves what was packed so far into the array's elements and returns false,
+// so that the element and the rest are parsed as usual.
+bool Parser::packElement(ParserContext::Frame &frame) {
+  using Packing = ParserContext::Frame::Packing;
+  const char ch = *curr_;
+  if ((ch == 't' || ch == 'f') && frame.packing != Packing::kNumbers) {
+    const bool val = ch == 't';
+    const char *literal = val ? "true" : "false";
+    const size_t length = val ? 4 : 5;
+    if (strncmp(curr_, literal, length) != 0) error("Invalid value");
+    curr_ += length;
+    frame.bools.push_back(val);
+    frame.packing = Packing::kBools;
+    return true;
+  }
+  if ((ch == '-' || isDigit(curr_)) && frame.packing != Packing::kBools) {
+    const char *start = curr_;
+    const char *digitsEnd = scanNumber();
+    double val;
+    uint64_t magnitude;
+    if (curr_ != digitsEnd) {
+      val = strtod(start, nullptr);
+      if (std::abs(val) == HUGE_VAL) error("Number out of bound");
+    } else if (readUint64(start + (ch == '-'), curr_, magnitude)
+        && magnitude < 1000000000000000) {
+      // Exact as a double, and written back without an exponent.
+      val = ch == '-' ? -static_cast<double>(magnitude)
+                      : static_cast<double>(magnitude);
+    } else {
+      curr_ = start;
+      unpack(frame);
+      return false;
+    }
+    frame.numbers.push_back(val);
+    frame.packing = Packing::kNumbers;
+    return true;
   }
+  unpack(frame);
+  return false;
+}
+
+void Parser::unpack(ParserContext::Frame &frame) {
+  for (auto val: frame.numbers) {
+    if (isPackedInteger(val))
+      frame.array.push_back(dedup(make<JsonInt64>(static_cast<int64_t>(val))));
+    else frame.array.push_back(dedup(make<JsonDouble>(val)));
+  }
+  for (auto val: frame.bools) frame.array.push_back(make<JsonBool>(val != 0));
+  frame.numbers.clear();
+  frame.bools.clear();
+  frame.packing = ParserContext::Frame::Packing::kNone;
+}
+
+// Turns the innermost open container into a value.
+Json Parser::closeContainer(ParserContext::Frame &frame) {
+  using Packing = ParserContext::Frame::Packing;
+  --depth_;
+  if (frame.isObject) {
+    if (context_)
+      context_->recordSize(context_->objectSizes_, depth_, frame.object.size());
+    return make<JsonObject>(std::move(frame.object));
+  }
+  switch (frame.packing) {
+    case Packing::kNumbers:
+      return make<JsonPackedNumbers>(std::move(frame.numbers));
+    case Packing::kBools: return make<JsonPackedBools>(std::move(frame.bools));
+    default: break;
+  }
+  if (context_)
+    context_->recordSize(context_->arraySizes_, depth_, frame.array.size());
+  return make<JsonArray>(std::move(frame.array));
 }
 
 /*
@@ -146,52 +344,60 @@ escape = %x5C          ; \
 quotation-mark = %x22  ; "
 unescaped = %x20-21 / %x23-5B / %x5D-10FFFF
  */
-std::string Parser::parseRawString() {
-  std::wstring_convert<std::codecvt_utf8<wchar_t> > convert;
-  std::ostringstream oss;
-  const char *p = curr_;
+const std::string &Parser::parseRawString() {
+  auto &scratch = context_ ? context_->scratch_ : ownScratch_;
+  scratch.clear();
+  parseRawString(scratch);
+  return scratch;
+}
+
+// Appends the decoded string to |out|. Runs without escapes are copied in one
+// go.
+void Parser::parseRawString(std::string &out) {
+  const char *p = curr_ + 1;
   for (;;) {
-    switch (*++p) {
+    const char *run = p;
+    p = skipUnescaped(p, end_);
+    out.append(run, p);
+    switch (*p) {
       // closing quote.
       case '\"': {
         curr_ = ++p;
-        const char *cstr = oss.str().c_str();
-        const auto size = oss.tellp();
-        return std::string(cstr, size);
+        return;
       }
         // Escape.
       case '\\':
         switch (*++p) {
           case '\"': {
-            oss << '\"';
+            out += '\"';
             break;
           }
           case '\\': {
-            oss << '\\';
+            out += '\\';
             break;
           }
           case '/': {
-            oss << '/';
+            out += '/';
             break;
           }
           case 'b': {
-            oss << '\b';
+            out += '\b';
             break;
           }
           case 'f': {
-            oss << '\f';
+            out += '\f';
             break;
           }
           case 'n': {
-            oss << '\n';
+            out += '\n';
             break;
           }
           case 't': {
-            oss << '\t';
+            out += '\t';
             break;
           }
           case 'r': {
-            oss << '\r';
+            out += '\r';
             break;
           }
           case 'u': {
@@ -208,21 +414,15 @@ std::string Parser::parseRawString() {
                   (((highSurrogate - 0xd800) << 10) | (lowSurrogate - 0xdc00))
                       + 0x10000;
             }
-            std::string utf8 = convert.to_bytes(highSurrogate);
-            // cannot convert to char* here because if utf8='\0', stf8.c_str()
-            // will terminate right away. Therefore manually push char into the
-            // stream.
-            for (auto &ch: utf8) oss << ch;
+            appendUtf8(out, static_cast<uint32_t>(highSurrogate));
             break;
           }
           default: error("Invalid escape character");
         }
+        ++p;
         break;
       case '\0':error("Missing quotation mark");
-      default:
-        if (static_cast<unsigned char>(*p) < 0x20)
-          error("Invalid character");
-        oss << *p;
+      default: error("Invalid character");
     }
   }
 }
@@ -233,15 +433,7 @@ void Parser::parseWhiteSpace() {
 }
 
 int Parser::parse4hex(const char **p) {
-  int u = 0;
-  for (int i = 0; i < 4; ++i) {
-    auto curr = static_cast<unsigned>(toupper(*++*p));
-    u <<= 4;
-    if ('0' <= curr && curr <= '9') u |= (curr - '0');
-    else if ('A' <= curr && curr <= 'F') u |= (curr - 'A' + 10);
-    else {
-      error("Invalid hex value");
-    }
-  }
+  int u;
+  if (!lightjson::parse4hex(*p, u)) error("Invalid hex value");
   return u;
 }
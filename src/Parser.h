@@ -5,38 +5,107 @@
 #ifndef LIGHTJSON_PARSER_H
 #define LIGHTJSON_PARSER_H
 
+#include <cstring>
 #include <string>
+#include <vector>
 #include "../include/Json.h"
 #include "JsonType.h"
 #include "JsonException.h"
+#include "Interner.h"
+#include "JsonValue.h"
+#include "NodePool.h"
+#include "../include/ParserContext.h"
+#include "../include/Projection.h"
 
 namespace lightjson {
 
+class Columns;
+struct Column;
+
+// A step from a container to one of its values, see Parser::locate().
+struct PathStep {
+  bool isKey;
+  std::string key;
+  size_t index;
+};
+
 class Parser {
  public:
   // Ctor
-  explicit Parser(const char *data) : curr_(data) {}
-  explicit Parser(const std::string &data) : curr_(data.c_str()) {}
+  explicit Parser(const char *data,
+                  const ParseOptions &options = ParseOptions())
+      : curr_(data), end_(data + strlen(data)), options_(options) {}
+  explicit Parser(const std::string &data,
+                  const ParseOptions &options = ParseOptions(),
+                  ParserContext *context = nullptr)
+      : curr_(data.c_str()),
+        end_(data.c_str() + data.size()),
+        options_(options),
+        context_(context) {}
   // Make the Parser uncopiable.
   Parser(const Parser &) = delete;
   Parser &operator=(const Parser &) = delete;
 
   Json parse();
+  // See Columns::extract().
+  void parseColumns(Columns &);
+  // See Json::reparse(). Finds the innermost value whose text strictly
+  // contains the bytes [first, last) of the text, and the path to it through
+  // |tree|, which was parsed from the text. Returns false if that is the
+  // root, or if the tree does not match the text.
+  bool locate(size_t first,
+              size_t last,
+              const Json &tree,
+              std::vector<PathStep> &path,
+              size_t &begin,
+              size_t &end);
 
  private:
   const char *curr_;
+  const char *const end_;
+  const ParseOptions options_;
+  // Only set while parsing with ParseOptions::deduplicate.
+  Interner *interner_ = nullptr;
+  ParserContext *const context_ = nullptr;
+  // Number of containers open.
+  size_t depth_ = 0;
+  // What the next value is filtered by, see Projection.
+  size_t projection_;
+  // Strings are decoded here first, and open containers are filled in the
+  // first |depth_| frames. Both are owned by the context if there is one.
+  std::string ownScratch_;
+  std::vector<ParserContext::Frame> ownFrames_;
 
   Json parseValue();
-  Json parseLiteral(const std::string &);
+  Json parseLiteral(const char *, size_t);
   Json parseNumber();
+  const char *scanNumber();
   Json parseString();
-  Json parseArray();
-  Json parseObject();
+  void parseKey(std::string &);
+  bool nextMember(ParserContext::Frame &);
+  void skipValue();
+  void skipString();
+  void parseCell(Columns &, Column &);
+  Json closeContainer(ParserContext::Frame &);
+  bool packElement(ParserContext::Frame &);
+  void unpack(ParserContext::Frame &);
 
-  std::string parseRawString();
+  void parseRawString(std::string &);
+  const std::string &parseRawString();
+  template<typename T, typename... Args>
+  Json make(Args &&... args) {
+    if (context_)
+      return Json(std::allocate_shared<T>(PoolAllocator<T>(context_->pool_),
+                                          std::forward<Args>(args)...));
+    return Json(std::make_shared<T>(std::forward<Args>(args)...));
+  }
+  Json &&dedup(Json &&json) {
+    if (interner_) interner_->intern(json);
+    return std::move(json);
+  }
   void parseWhiteSpace();
   int parse4hex(const char **);
-  void error(const std::string &msg) const {
+  [[noreturn]] void error(const std::string &msg) const {
     throw JsonException(msg + ": " + curr_);
   }
 };
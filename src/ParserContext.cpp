@@ -0,0 +1,110 @@
+#include <algorithm>
+#include "../include/ParserContext.h"
+#include "JsonValue.h"
+#include "JsonException.h"
+#include "NodePool.h"
+#include "Parser.h"
+
+using namespace ::lightjson;
+
+ParserContext::ParserContext() : pool_(NodePool::create()) {}
+
+// Nodes handed out earlier keep the pool alive until they are gone.
+ParserContext::~ParserContext() { pool_->release(); }
+
+Json ParserContext::parse(const std::string &data, std::string &error) {
+  return parse(data, error, ParseOptions());
+}
+
+Json ParserContext::parse(const std::string &data,
+                          std::string &error,
+                          const ParseOptions &options) {
+  try {
+    Parser p(data, options, this);
+    return p.parse();
+  } catch (JsonException &e) {
+    error = e.what();
+    return Json(nullptr);
+  }
+}
+
+void ParserContext::recycle(Json &&json) {
+  pending_.push_back(std::move(json));
+  while (!pending_.empty()) {
+    Json curr = std::move(pending_.back());
+    pending_.pop_back();
+    if (!curr.value_ || curr.value_.use_count() != 1) continue;
+    auto &value = *curr.value_;
+    switch (value.type()) {
+      case JsonType::kString: {
+        auto &str = value.stringValue();
+        // Strings within the small string buffer own no storage.
+        if (str.capacity() > std::string().capacity()
+            && str.capacity() <= kMaxRecycledCapacity
+            && strings_.size() < kMaxRecycled)
+          strings_.push_back(std::move(str));
+        break;
+      }
+      case JsonType::kArray: {
+        if (value.isPacked()) break;
+        auto &arr = value.arrayItems();
+        for (auto &e: arr) pending_.push_back(std::move(e));
+        arr.clear();
+        if (arr.capacity() && arr.capacity() <= kMaxRecycledCapacity
+            && arrays_.size() < kMaxRecycled)
+          arrays_.push_back(std::move(arr));
+        break;
+      }
+      case JsonType::kObject: {
+        auto &obj = value.objectItems();
+        for (auto &p: obj) pending_.push_back(std::move(p.second));
+        obj.clear();
+        if (obj.bucket_count() <= kMaxRecycledCapacity
+            && objects_.size() < kMaxRecycled)
+          objects_.push_back(std::move(obj));
+        break;
+      }
+      default: break;
+    }
+  }
+}
+
+Json::array ParserContext::takeArray(size_t depth) {
+  Json::array arr;
+  if (!arrays_.empty()) {
+    arr = std::move(arrays_.back());
+    arrays_.pop_back();
+  }
+  if (depth < arraySizes_.size()) arr.reserve(arraySizes_[depth].reserve);
+  return arr;
+}
+
+Json::object ParserContext::takeObject(size_t depth) {
+  Json::object obj;
+  if (!objects_.empty()) {
+    obj = std::move(objects_.back());
+    objects_.pop_back();
+  }
+  // reserve() may also shrink the bucket array, so only ever grow it.
+  if (depth < objectSizes_.size()
+      && obj.bucket_count() * obj.max_load_factor() < objectSizes_[depth].reserve)
+    obj.reserve(objectSizes_[depth].reserve);
+  return obj;
+}
+
+std::string ParserContext::takeString(const std::string &str) {
+  if (strings_.empty()) return str;
+  auto retVal = std::move(strings_.back());
+  strings_.pop_back();
+  retVal.assign(str);
+  return retVal;
+}
+
+void ParserContext::recordSize(std::vector<SizeHint> &sizes,
+                               size_t depth,
+                               size_t size) {
+  if (depth >= sizes.size()) sizes.resize(depth + 1);
+  auto &hint = sizes[depth];
+  hint.reserve = std::min({hint.last, size, kMaxRecycledCapacity});
+  hint.last = size;
+}
@@ -0,0 +1,54 @@
+#include "../include/Projection.h"
+
+using namespace ::lightjson;
+
+constexpr size_t Projection::kAll;
+constexpr size_t Projection::kSkip;
+
+Projection::Projection() : nodes_(1) {}
+
+Projection::Projection(std::initializer_list<std::string> paths)
+    : Projection() {
+  for (const auto &path: paths) add(path);
+}
+
+void Projection::add(const std::string &path) {
+  std::vector<std::string> keys;
+  size_t begin = 0;
+  for (;;) {
+    const size_t end = path.find('.', begin);
+    keys.push_back(path.substr(begin, end - begin));
+    if (end == std::string::npos) break;
+    begin = end + 1;
+  }
+  add(keys);
+}
+
+void Projection::add(const std::vector<std::string> &keys) {
+  size_t node = 0;
+  for (const auto &key: keys) {
+    // Everything below is kept already.
+    if (nodes_[node].keepAll) return;
+    auto &children = nodes_[node].children;
+    auto it = children.find(key);
+    if (it != children.end()) {
+      node = it->second;
+      continue;
+    }
+    // Growing nodes_ may move |children|, so it is not used after.
+    const size_t child = nodes_.size();
+    children.emplace(key, child);
+    nodes_.emplace_back();
+    node = child;
+  }
+  nodes_[node].keepAll = true;
+  nodes_[node].children.clear();
+}
+
+size_t Projection::member(size_t node, const std::string &key) const {
+  if (node == kAll) return kAll;
+  const auto &children = nodes_[node].children;
+  auto it = children.find(key);
+  if (it == children.end()) return kSkip;
+  return nodes_[it->second].keepAll ? kAll : it->second;
+}
@@ -0,0 +1,131 @@
+#include "../include/Json.h"
+#include "JsonValue.h"
+#include "Parser.h"
+
+using namespace ::lightjson;
+
+// Walks down from the root, skipping the values before the edit the way a
+// Projection skips members, and descends into the value that holds it. An
+// edited value is only parsed on its own if the text around it is unchanged,
+// so that it is read in the same place the full parse would read it.
+bool Parser::locate(size_t first,
+                    size_t last,
+                    const Json &tree,
+                    std::vector<PathStep> &path,
+                    size_t &begin,
+                    size_t &end) {
+  const char *const text = curr_;
+  const char *const editBegin = text + first;
+  const char *const editEnd = text + last;
+  std::string &key = ownScratch_;
+  std::string other;
+  const Json *node = &tree;
+  parseWhiteSpace();
+  for (;;) {
+    const auto &value = node->value();
+    const bool isObject = *curr_ == '{';
+    if (!isObject && *curr_ != '[') break;
+    if (value.type() != (isObject ? JsonType::kObject : JsonType::kArray))
+      return false;
+    // Packed arrays are parsed again whole, so that they stay packed.
+    if (value.isPacked()) break;
+    curr_++;
+    parseWhiteSpace();
+    const char *childBegin = nullptr;
+    const char *childEnd = nullptr;
+    size_t index = 0;
+    bool found = false;
+    while (*curr_ != ']' && *curr_ != '}') {
+      if (isObject) parseKey(key);
+      childBegin = curr_;
+      skipValue();
+      childEnd = curr_;
+      if (childEnd >= editBegin) {
+        found = childBegin < editBegin && editEnd < childEnd;
+        break;
+      }
+      parseWhiteSpace();
+      if (*curr_ != ',') break;
+      curr_++;
+      parseWhiteSpace();
+      ++index;
+    }
+    if (!found) break;
+    const Json *child;
+    if (isObject) {
+      // The last of duplicate keys wins, so an earlier one is not in the tree.
+      bool duplicate = false;
+      for (parseWhiteSpace(); *curr_ == ','; parseWhiteSpace()) {
+        curr_++;
+        parseWhiteSpace();
+        parseKey(other);
+        if (other == key) {
+          duplicate = true;
+          break;
+        }
+        skipValue();
+      }
+      if (duplicate) break;
+      child = value.find(key);
+      path.push_back(PathStep{true, key, 0});
+    } else {
+      child = index < value.size() ? &value[index] : nullptr;
+      path.push_back(PathStep{false, std::string(), index});
+    }
+    if (!child) return false;
+    node = child;
+    begin = childBegin - text;
+    end = childEnd - text;
+    curr_ = childBegin;
+  }
+  return !path.empty();
+}
+
+bool Json::reparse(Json &json,
+                   std::string &text,
+                   const TextEdit &edit,
+                   std::string &error,
+                   const ParseOptions &options) {
+  if (edit.offset > text.size() || edit.removed > text.size() - edit.offset) {
+    error = "Edit out of range";
+    return false;
+  }
+  std::vector<PathStep> path;
+  size_t begin = 0;
+  size_t end = 0;
+  bool local = false;
+  if (!options.projection) {
+    try {
+      Parser parser(text, options);
+      local = parser.locate(edit.offset, edit.offset + edit.removed, json,
+                            path, begin, end);
+    } catch (JsonException &) {
+      local = false;
+    }
+  }
+  text.replace(edit.offset, edit.removed, edit.inserted);
+  if (local && path.size() < options.maxDepth) {
+    end = end - edit.removed + edit.inserted.size();
+    ParseOptions valueOptions = options;
+    valueOptions.maxDepth -= path.size();
+    std::string valueError;
+    Json value = parse(text.substr(begin, end - begin), valueError,
+                       valueOptions);
+    // Otherwise the edit reaches past the value, and the full parse tells.
+    if (valueError.empty()) {
+      Json *target = &json;
+      for (const auto &step: path)
+        target = step.isKey ? target->find(step.key) : &(*target)[step.index];
+      *target = std::move(value);
+      return true;
+    }
+  }
+  std::string fullError;
+  Json full = parse(text, fullError, options);
+  if (!fullError.empty()) {
+    error = fullError;
+    return false;
+  }
+  json = std::move(full);
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef LIGHTJSON_STRINGSCAN_H
+#define LIGHTJSON_STRINGSCAN_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace lightjson {
+
+// Returns the first byte in [p, end) that can't appear in a JSON string as
+// is: a quote, a backslash or a control character. Returns |end| if there is
+// none. Goes 16 bytes at a time where SSE2 is available.
+inline const char *skipUnescaped(const char *p, const char *end) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i maxControl = _mm_set1_epi8(0x1f);
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // There is no unsigned byte compare; v <= 0x1f iff max(v, 0x1f) == 0x1f.
+    const __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, maxControl), maxControl));
+    const int mask = _mm_movemask_epi8(special);
+    if (mask) return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p != end; ++p) {
+    const auto ch = static_cast<unsigned char>(*p);
+    if (ch == '"' || ch == '\\' || ch < 0x20) break;
+  }
+  return p;
+}
+
+// Same as skipUnescaped(), but also stops at the first non-ASCII byte.
+inline const char *skipUnescapedAscii(const char *p, const char *end) {
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i maxControl = _mm_set1_epi8(0x1f);
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, maxControl), maxControl));
+    // Non-ASCII bytes are the ones with the sign bit set.
+    const int mask = _mm_movemask_epi8(special) | _mm_movemask_epi8(v);
+    if (mask) return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p != end; ++p) {
+    const auto ch = static_cast<unsigned char>(*p);
+    if (ch == '"' || ch == '\\' || ch < 0x20 || ch >= 0x80) break;
+  }
+  return p;
+}
+
+// Returns the first quote or bracket in [p, end), or |end| if there is none.
+inline const char *skipToBracketOrQuote(const char *p, const char *end) {
+#ifdef __SSE2__
+  // '[' and ']' differ from '{' and '}' only in bit 0x20.
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i open = _mm_set1_epi8('{');
+  const __m128i close = _mm_set1_epi8('}');
+  const __m128i caseBit = _mm_set1_epi8(0x20);
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    const __m128i folded = _mm_or_si128(v, caseBit);
+    const __m128i special = _mm_or_si128(
+        _mm_cmpeq_epi8(v, quote),
+        _mm_or_si128(_mm_cmpeq_epi8(folded, open),
+                     _mm_cmpeq_epi8(folded, close)));
+    const int mask = _mm_movemask_epi8(special);
+    if (mask) return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p != end; ++p) {
+    const char ch = *p;
+    if (ch == '"' || ch == '[' || ch == ']' || ch == '{' || ch == '}') break;
+  }
+  return p;
+}
+
+} // namespace
+
+#endif //LIGHTJSON_STRINGSCAN_H
@@ -0,0 +1,197 @@
+#include <cstdint>
+#include <cstring>
+#include "Utf8.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LIGHTJSON_UTF8_SSSE3
+#include <immintrin.h>
+#endif
+
+using namespace ::lightjson;
+
+namespace {
+
+bool isValidUtf8Scalar(const unsigned char *p, const unsigned char *end) {
+  while (p != end) {
+    // Skip ASCII eight bytes at a time.
+    if (end - p >= 8) {
+      uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+      if (!(word & 0x8080808080808080ULL)) {
+        p += 8;
+        continue;
+      }
+    }
+    const unsigned char lead = *p;
+    if (lead < 0x80) {
+      ++p;
+      continue;
+    }
+    // The range of the second byte depends on the lead byte, the remaining
+    // continuation bytes are always 80..BF.
+    int continuations;
+    unsigned char low = 0x80, high = 0xbf;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+      continuations = 1;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+      continuations = 2;
+      if (lead == 0xe0) low = 0xa0;       // overlong
+      else if (lead == 0xed) high = 0x9f; // surrogates
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+      continuations = 3;
+      if (lead == 0xf0) low = 0x90;       // overlong
+      else if (lead == 0xf4) high = 0x8f; // above U+10FFFF
+    } else {
+      return false;
+    }
+    if (end - p <= continuations) return false;
+    if (p[1] < low || p[1] > high) return false;
+    for (int i = 2; i <= continuations; ++i)
+      if ((p[i] & 0xc0) != 0x80) return false;
+    p += continuations + 1;
+  }
+  return true;
+}
+
+#ifdef LIGHTJSON_UTF8_SSSE3
+// The lookup algorithm from Keiser and Lemire, "Validating UTF-8 In Less
+// Than One Instruction Per Byte" (2021). Each byte is classified together with
+// the one before it through three 16-entry tables, every error pattern maps
+// to one bit, and a valid pair of bytes ANDs down to zero.
+constexpr uint8_t kTooShort = 1 << 0;   // 11______ 0_______ / 11______ 11______
+constexpr uint8_t kTooLong = 1 << 1;    // 0_______ 10______
+constexpr uint8_t kOverlong3 = 1 << 2;  // 11100000 100_____
+constexpr uint8_t kTooLarge = 1 << 3;   // 11110100 1001____ and above
+constexpr uint8_t kSurrogate = 1 << 4;  // 11101101 101_____
+constexpr uint8_t kOverlong2 = 1 << 5;  // 1100000_ 10______
+constexpr uint8_t kTooLarge1000 = 1 << 6; // 11110101 1000____ and above
+constexpr uint8_t kOverlong4 = 1 << 6;  // 11110000 1000____
+constexpr uint8_t kTwoConts = 1 << 7;   // 10______ 10______
+constexpr uint8_t kCarry = kTooShort | kTooLong | kTwoConts;
+
+__attribute__((target("ssse3")))
+inline __m128i highNibbles(__m128i v) {
+  return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+}
+
+__attribute__((target("ssse3")))
+inline __m128i checkSpecialCases(__m128i input, __m128i prev1) {
+  const __m128i byte1HighTable = _mm_setr_epi8(
+      kTooLong, kTooLong, kTooLong, kTooLong,
+      kTooLong, kTooLong, kTooLong, kTooLong,
+      kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+      kTooShort | kOverlong2,
+      kTooShort,
+      kTooShort | kOverlong3 | kSurrogate,
+      static_cast<char>(kTooShort | kTooLarge | kTooLarge1000 | kOverlong4));
+  const __m128i byte1LowTable = _mm_setr_epi8(
+      static_cast<char>(kCarry | kOverlong3 | kOverlong2 | kOverlong4),
+      static_cast<char>(kCarry | kOverlong2),
+      static_cast<char>(kCarry),
+      static_cast<char>(kCarry),
+      static_cast<char>(kCarry | kTooLarge),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000 | kSurrogate),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000),
+      static_cast<char>(kCarry | kTooLarge | kTooLarge1000));
+  const __m128i byte2HighTable = _mm_setr_epi8(
+      kTooShort, kTooShort, kTooShort, kTooShort,
+      kTooShort, kTooShort, kTooShort, kTooShort,
+      static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kOverlong3
+          | kTooLarge1000 | kOverlong4),
+      static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kOverlong3
+          | kTooLarge),
+      static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kSurrogate
+          | kTooLarge),
+      static_cast<char>(kTooLong | kOverlong2 | kTwoConts | kSurrogate
+          | kTooLarge),
+      kTooShort, kTooShort, kTooShort, kTooShort);
+  const __m128i byte1High = _mm_shuffle_epi8(byte1HighTable, highNibbles(prev1));
+  const __m128i byte1Low = _mm_shuffle_epi8(
+      byte1LowTable, _mm_and_si128(prev1, _mm_set1_epi8(0x0f)));
+  const __m128i byte2High = _mm_shuffle_epi8(byte2HighTable, highNibbles(input));
+  return _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+}
+
+__attribute__((target("ssse3")))
+inline __m128i checkBlock(__m128i input, __m128i prevInput) {
+  const __m128i prev1 = _mm_alignr_epi8(input, prevInput, 15);
+  const __m128i special = checkSpecialCases(input, prev1);
+  // The third and fourth bytes of a sequence must be continuations; the two
+  // byte tables above only see pairs, so those are found separately.
+  const __m128i prev2 = _mm_alignr_epi8(input, prevInput, 14);
+  const __m128i prev3 = _mm_alignr_epi8(input, prevInput, 13);
+  const __m128i isThirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+  const __m128i isFourthByte =
+      _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+  const __m128i mustBe23Continuation = _mm_and_si128(
+      _mm_or_si128(isThirdByte, isFourthByte),
+      _mm_set1_epi8(static_cast<char>(0x80)));
+  return _mm_xor_si128(mustBe23Continuation, special);
+}
+
+// A sequence that starts in the last three bytes of a block and continues in
+// the next one.
+__attribute__((target("ssse3")))
+inline __m128i isIncomplete(__m128i input) {
+  const __m128i maxValue = _mm_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      static_cast<char>(0xf0 - 1), static_cast<char>(0xe0 - 1),
+      static_cast<char>(0xc0 - 1));
+  return _mm_subs_epu8(input, maxValue);
+}
+
+struct Ssse3State {
+  __m128i error = _mm_setzero_si128();
+  __m128i prevInput = _mm_setzero_si128();
+  __m128i prevIncomplete = _mm_setzero_si128();
+};
+
+__attribute__((target("ssse3")))
+inline void checkNextBlock(__m128i input, Ssse3State &state) {
+  if (_mm_movemask_epi8(input) == 0) {
+    // Pure ASCII, only a sequence left open by the last block can be wrong.
+    state.error = _mm_or_si128(state.error, state.prevIncomplete);
+  } else {
+    state.error =
+        _mm_or_si128(state.error, checkBlock(input, state.prevInput));
+    state.prevIncomplete = isIncomplete(input);
+  }
+  state.prevInput = input;
+}
+
+__attribute__((target("ssse3")))
+bool isValidUtf8Ssse3(const char *p, const char *end) {
+  Ssse3State state;
+  for (; end - p >= 16; p += 16)
+    checkNextBlock(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+                   state);
+  // The tail is zero-padded. The block of zeros after it flushes a sequence
+  // still open at the very end, since NUL is no continuation byte.
+  char tail[16] = {};
+  std::memcpy(tail, p, end - p);
+  checkNextBlock(_mm_loadu_si128(reinterpret_cast<const __m128i *>(tail)),
+                 state);
+  checkNextBlock(_mm_setzero_si128(), state);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(state.error, _mm_setzero_si128()))
+      == 0xffff;
+}
+#endif
+
+} // namespace
+
+bool lightjson::isValidUtf8(const char *begin, const char *end) {
+#ifdef LIGHTJSON_UTF8_SSSE3
+  static const bool hasSsse3 = __builtin_cpu_supports("ssse3");
+  if (hasSsse3) return isValidUtf8Ssse3(begin, end);
+#endif
+  return isValidUtf8Scalar(reinterpret_cast<const unsigned char *>(begin),
+                           reinterpret_cast<const unsigned char *>(end));
+}
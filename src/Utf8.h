@@ -0,0 +1,81 @@
+#ifndef LIGHTJSON_UTF8_H
+#define LIGHTJSON_UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace lightjson {
+
+// Checks that [begin, end) is well-formed UTF-8 (RFC 3629): no overlong
+// forms, no surrogates, nothing above U+10FFFF. Uses an SSSE3 kernel when the
+// CPU has one, and never allocates.
+bool isValidUtf8(const char *begin, const char *end);
+
+// Decodes the code point at |p| into |u|. Returns the length of its encoding,
+// or 0 if the bytes at |p| are not well-formed.
+inline size_t decodeUtf8(const char *p, const char *end, uint32_t &u) {
+  const auto lead = static_cast<unsigned char>(*p);
+  size_t size;
+  uint32_t min;
+  if (lead < 0x80) {
+    u = lead;
+    return 1;
+  } else if (0xc2 <= lead && lead <= 0xdf) {
+    size = 2;
+    min = 0x80;
+    u = lead & 0x1f;
+  } else if ((lead & 0xf0) == 0xe0) {
+    size = 3;
+    min = 0x800;
+    u = lead & 0x0f;
+  } else if (0xf0 <= lead && lead <= 0xf4) {
+    size = 4;
+    min = 0x10000;
+    u = lead & 0x07;
+  } else {
+    return 0;
+  }
+  if (static_cast<size_t>(end - p) < size) return 0;
+  for (size_t i = 1; i != size; ++i) {
+    const auto ch = static_cast<unsigned char>(p[i]);
+    if ((ch & 0xc0) != 0x80) return 0;
+    u = (u << 6) | (ch & 0x3f);
+  }
+  if (u < min || u > 0x10ffff || (0xd800 <= u && u <= 0xdfff)) return 0;
+  return size;
+}
+
+// The first byte in [begin, end) that does not start a well-formed code
+// point, or |end|. Only worth calling once isValidUtf8() has failed.
+inline const char *findInvalidUtf8(const char *begin, const char *end) {
+  uint32_t u;
+  for (const char *p = begin; p != end;) {
+    const size_t size = decodeUtf8(p, end, u);
+    if (!size) return p;
+    p += size;
+  }
+  return end;
+}
+
+inline void appendUtf8(std::string &out, uint32_t u) {
+  if (u < 0x80) {
+    out += static_cast<char>(u);
+  } else if (u < 0x800) {
+    out += static_cast<char>(0xc0 | (u >> 6));
+    out += static_cast<char>(0x80 | (u & 0x3f));
+  } else if (u < 0x10000) {
+    out += static_cast<char>(0xe0 | (u >> 12));
+    out += static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (u & 0x3f));
+  } else {
+    out += static_cast<char>(0xf0 | (u >> 18));
+    out += static_cast<char>(0x80 | ((u >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (u & 0x3f));
+  }
+}
+
+} // namespace
+
+#endif //LIGHTJSON_UTF8_H
@@ -3,11 +3,80 @@
 //
 
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
 #include <string>
+#include <mutex>
+#include <new>
+#include <random>
+#include <thread>
+#include "../include/Columnar.h"
 #include "../include/Json.h"
+#include "../include/JsonSnapshot.h"
+#include "../include/JsonStream.h"
+#include "../include/JsonWriter.h"
+#include "../include/ParseCache.h"
+#include "../include/ParsePool.h"
+#include "../include/ParserContext.h"
+#include "../include/Projection.h"
+#include "../include/StaticJson.h"
+
+#ifdef LIGHTJSON_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LIGHTJSON_WITH_ZSTD
+#include <zstd.h>
+#endif
 
 using namespace ::lightjson;
 
+// Allocations made by this thread while counting, see countAllocations().
+thread_local bool countingAllocations = false;
+thread_local size_t allocations = 0;
+
+// Allocations of at least this many bytes fail, except on threads that
+// clear |mayFailAllocations|. 0 lets every allocation through.
+std::atomic<size_t> failAllocationsFrom{0};
+thread_local bool mayFailAllocations = true;
+
+// Every form is replaced, so that none is paired with a library's own.
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  if (countingAllocations) ++allocations;
+  const size_t failFrom = failAllocationsFrom;
+  if (failFrom && size >= failFrom && mayFailAllocations) return nullptr;
+  return std::malloc(size ? size : 1);
+}
+void *operator new(size_t size) {
+  if (void *p = operator new(size, std::nothrow)) return p;
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return operator new(size, std::nothrow);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+size_t countAllocations(const std::function<void()> &fn) {
+  allocations = 0;
+  countingAllocations = true;
+  fn();
+  countingAllocations = false;
+  return allocations;
+}
+
 Json assertParseSuccess(const std::string &jsonStr) {
   std::string errMsg;
   auto json = Json::parse(jsonStr, errMsg);
@@ -283,6 +352,351 @@ TEST(RoundTrip, Object) {
   EXPECT_EQ(json, json2);
 }
 
+#define TEST_MINIFY(expect, strJson)                \
+  do {                                              \
+    std::string errMsg;                             \
+    EXPECT_EQ(expect, Json::minify(strJson, errMsg)); \
+    EXPECT_EQ(errMsg, "");                          \
+  } while (0)
+
+#define TEST_FORMAT_ERROR(expect, strJson)          \
+  do {                                              \
+    std::string errMsg;                             \
+    EXPECT_EQ(Json::minify(strJson, errMsg), "");   \
+    EXPECT_EQ(expect, errMsg.substr(0, errMsg.find_first_of(":"))); \
+  } while (0)
+
+TEST(Format, Minify) {
+  TEST_MINIFY("null", " null ");
+  TEST_MINIFY("-1.5e+10", "\t-1.5e+10\n");
+  TEST_MINIFY("\" a \\n\\u00A2 \"", " \" a \\n\\u00A2 \" ");
+  TEST_MINIFY("[]", "[ ]");
+  TEST_MINIFY("{}", " {\n} ");
+  TEST_MINIFY("[null,false,true,123,\"abc\",[1,2,3]]",
+              "[ null , false , true , 123 , \"abc\" , [ 1, 2, 3 ] ]");
+  // Members keep their order, unlike parse() followed by serialize().
+  TEST_MINIFY("{\"z\":1,\"a\":{\"b\":[{},[]]},\"m\":\"x\"}",
+              " { \"z\" : 1 ,\n \"a\" : { \"b\" : [ { } , [ ] ] } , "
+              "\"m\" : \"x\" } ");
+}
+
+TEST(Format, Prettify) {
+  std::string errMsg;
+  EXPECT_EQ(Json::prettify("[]", 2, errMsg), "[]");
+  EXPECT_EQ(Json::prettify("[1,[2]]", 2, errMsg), "[\n  1,\n  [\n    2\n  ]\n]");
+  EXPECT_EQ(Json::prettify(" { \"a\" : { } , \"b\" : [ true ] } ", 4, errMsg),
+            "{\n    \"a\": {},\n    \"b\": [\n        true\n    ]\n}");
+  EXPECT_EQ(Json::prettify("{\"a\":1}", 0, errMsg), "{\n\"a\": 1\n}");
+  EXPECT_EQ(errMsg, "");
+  // Prettified text minifies back to the original.
+  const std::string minified = "{\"a\":[1,{\"b\":null}],\"c\":\"d\"}";
+  EXPECT_EQ(Json::minify(Json::prettify(minified, 3, errMsg), errMsg),
+            minified);
+  EXPECT_EQ(errMsg, "");
+}
+
+TEST(Format, Error) {
+  TEST_FORMAT_ERROR("Expect value", "");
+  TEST_FORMAT_ERROR("Expect value", "  ");
+  TEST_FORMAT_ERROR("Invalid value", "nul");
+  TEST_FORMAT_ERROR("Invalid value", "[1,]");
+  TEST_FORMAT_ERROR("Invalid value", "1.");
+  TEST_FORMAT_ERROR("Root not singular", "null x");
+  TEST_FORMAT_ERROR("Root not singular", "[] ]");
+  TEST_FORMAT_ERROR("Missing quotation mark", "\"abc");
+  TEST_FORMAT_ERROR("Invalid escape character", "\"\\v\"");
+  TEST_FORMAT_ERROR("Invalid character", "\"\x01\"");
+  TEST_FORMAT_ERROR("Invalid hex value", "\"\\u0G00\"");
+  TEST_FORMAT_ERROR("Invalid unicode surrogate", "\"\\uD800\\uE000\"");
+  TEST_FORMAT_ERROR("Missing closing bracket or comma", "[1 2");
+  TEST_FORMAT_ERROR("Missing closing bracket or comma", "[1}");
+  TEST_FORMAT_ERROR("Missing closing bracket or comma", "{\"a\":1]");
+  TEST_FORMAT_ERROR("Missing key", "{1:1}");
+  TEST_FORMAT_ERROR("Missing key", "{\"a\":1,}");
+  TEST_FORMAT_ERROR("Missing colon", "{\"a\",\"b\"}");
+  std::string errMsg;
+  EXPECT_EQ(Json::prettify("[1,", 2, errMsg), "");
+  EXPECT_NE(errMsg, "");
+}
+
+#define TEST_VALIDATE_ERROR(expect, strJson)                          \
+  do {                                                                \
+    std::string errMsg;                                               \
+    EXPECT_FALSE(Json::validate(strJson, errMsg));                    \
+    EXPECT_EQ(expect, errMsg.substr(0, errMsg.find_first_of(":")));   \
+  } while (0)
+
+TEST(Validate, Success) {
+  std::string errMsg;
+  EXPECT_TRUE(Json::validate("null", errMsg));
+  EXPECT_TRUE(Json::validate(" [1, -2.5e3, \"\\u00A2\", {\"a\": {}}] ", errMsg));
+  EXPECT_TRUE(Json::validate("\"\xC2\xA2 \xE2\x82\xAC \xF0\x9D\x84\x9E\"",
+                             errMsg));
+  // Long strings go through the vectorized scan.
+  EXPECT_TRUE(Json::validate(
+      "{\"long\": \"" + std::string(100, 'x') + "\\n" + std::string(37, 'y')
+          + "\xE2\x82\xAC\"}", errMsg));
+  // Deeper than BitStack keeps inline.
+  EXPECT_TRUE(Json::validate(std::string(1000, '[') + std::string(1000, ']'),
+                             errMsg));
+  EXPECT_EQ(errMsg, "");
+}
+
+TEST(Validate, Error) {
+  TEST_VALIDATE_ERROR("Expect value", "");
+  TEST_VALIDATE_ERROR("Invalid value", "[1,]");
+  TEST_VALIDATE_ERROR("Root not singular", "{} {}");
+  TEST_VALIDATE_ERROR("Missing closing bracket or comma",
+                      std::string(300, '[') + std::string(299, ']'));
+  TEST_VALIDATE_ERROR("Missing quotation mark",
+                      "\"" + std::string(40, 'a'));
+  TEST_VALIDATE_ERROR("Invalid character",
+                      "\"" + std::string(20, 'a') + "\x1F\"");
+  TEST_VALIDATE_ERROR("Invalid UTF-8", "\"\xC0\xAF\"");          // overlong
+  TEST_VALIDATE_ERROR("Invalid UTF-8", "\"\xED\xA0\x80\"");      // surrogate
+  TEST_VALIDATE_ERROR("Invalid UTF-8", "\"\xF4\x90\x80\x80\"");  // > U+10FFFF
+  TEST_VALIDATE_ERROR("Invalid UTF-8", "\"\xE2\x82\"");          // truncated
+  TEST_VALIDATE_ERROR("Invalid UTF-8", "\"\x80\"");              // stray
+  TEST_VALIDATE_ERROR("Invalid UTF-8",
+                      "\"" + std::string(30, 'a') + "\xE2\x82");
+  TEST_VALIDATE_ERROR("Number out of bound", "1e400");
+  TEST_VALIDATE_ERROR("Number out of bound", "-1e400");
+  TEST_VALIDATE_ERROR("Number out of bound", "[1e999]");
+  TEST_VALIDATE_ERROR("Number out of bound", "{\"a\":1e309}");
+  TEST_VALIDATE_ERROR("Number out of bound", "[2.5E+309, 1]");
+  TEST_VALIDATE_ERROR("Number out of bound", "1" + std::string(400, '0'));
+  // Same error, pointing at the same place, as parse().
+  std::string validateErr, parseErr;
+  Json::validate("[1, 1e400, 2]", validateErr);
+  Json::parse("[1, 1e400, 2]", parseErr);
+  EXPECT_EQ(validateErr, parseErr);
+  // Large, but within a double.
+  EXPECT_TRUE(Json::validate("[1e308, -1.7976931348623157e308, 1e-400]",
+                             validateErr));
+}
+
+TEST(ParseError, MaxDepth) {
+  const auto deep = [](size_t depth) {
+    return std::string(depth, '[') + std::string(depth, ']');
+  };
+  std::string errMsg;
+  Json::parse(deep(1001), errMsg);
+  EXPECT_EQ(errMsg.substr(0, errMsg.find_first_of(":")),
+            "Exceed maximum depth");
+  errMsg.clear();
+  EXPECT_FALSE(Json::validate(deep(1001), errMsg));
+  EXPECT_EQ(errMsg.substr(0, errMsg.find_first_of(":")),
+            "Exceed maximum depth");
+  errMsg.clear();
+  EXPECT_TRUE(Json::validate(deep(1000), errMsg));
+  assertParseSuccess(deep(1000));
+
+  ParseOptions options;
+  options.maxDepth = 2;
+  Json::parse("[{\"a\": 1}, []]", errMsg, options);
+  EXPECT_EQ(errMsg, "");
+  Json::parse("[{\"a\": {}}]", errMsg, options);
+  EXPECT_EQ(errMsg.substr(0, errMsg.find_first_of(":")),
+            "Exceed maximum depth");
+
+  // Parsing, serializing and destroying deep documents must not recurse.
+  const size_t depth = 100000;
+  options.maxDepth = depth;
+  std::string text;
+  for (size_t i = 0; i != depth; ++i) text += i % 2 ? "{\"k\":" : "[";
+  text += "0";
+  for (size_t i = depth; i-- != 0;) text += i % 2 ? "}" : "]";
+  errMsg.clear();
+  {
+    const auto json = Json::parse(text, errMsg, options);
+    EXPECT_EQ(errMsg, "");
+    EXPECT_EQ(json.serialize(true), text);
+  }
+}
+
+TEST(ParseError, InvalidUtf8) {
+  ParseOptions options;
+  options.strictUtf8 = true;
+  std::string errMsg;
+  Json::parse("[\"\xE2\x82\xAC\", \"\xC3\"]", errMsg, options);
+  EXPECT_EQ(errMsg, "Invalid UTF-8: \xC3\"]");
+  // validate() points at the same byte.
+  errMsg.clear();
+  EXPECT_FALSE(Json::validate("[\"\xE2\x82\xAC\", \"\xC3\"]", errMsg));
+  EXPECT_EQ(errMsg, "Invalid UTF-8: \xC3\"]");
+  errMsg.clear();
+  auto json = Json::parse("[\"\xE2\x82\xAC\"]", errMsg, options);
+  EXPECT_EQ(errMsg, "");
+  EXPECT_EQ(json[0].toString(), "\xE2\x82\xAC");
+  // Not strict by default.
+  assertParseSuccess("[\"\xC3\"]");
+}
+
+TEST(Serialize, Compact) {
+  auto json = assertParseSuccess("[null, {\"a\": [1, \"b\"]}, []]");
+  EXPECT_EQ(json.serialize(true), "[null,{\"a\":[1,\"b\"]},[]]");
+  EXPECT_EQ(json.serialize(), "[null, {\"a\": [1, \"b\"]}, []]");
+  // Keys are escaped like any other string.
+  json = assertParseSuccess("{\"a\\\"b\\n\": 1}");
+  EXPECT_EQ(json.serialize(true), "{\"a\\\"b\\n\":1}");
+}
+
+TEST(Serialize, Escape) {
+  // Control characters are escaped in hex.
+  EXPECT_EQ(Json(std::string("\x10\x1f\x7f")).serialize(),
+            "\"\\u0010\\u001f\x7f\"");
+  // Escapes on both sides of the 16 byte blocks.
+  const std::string run(40, 'a');
+  EXPECT_EQ(Json("\"" + run + "\n" + run + "\\").serialize(),
+            "\"\\\"" + run + "\\n" + run + "\\\\\"");
+  SerializeOptions options;
+  options.asciiOnly = true;
+  // U+00E9, U+20AC, U+1D11E, then a stray continuation byte.
+  const std::string text =
+      run + "\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E\x80\"";
+  EXPECT_EQ(Json(text).serialize(options),
+            "\"" + run + "\\u00e9\\u20ac\\ud834\\udd1e\\ufffd\\\"\"");
+  std::string errMsg;
+  EXPECT_EQ(Json::parse(Json(text).serialize(options), errMsg).toString(),
+            run + "\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E\xEF\xBF\xBD\"");
+  // Without asciiOnly, UTF-8 is written as is.
+  EXPECT_EQ(Json(text).serialize(),
+            "\"" + text.substr(0, text.size() - 1) + "\\\"\"");
+}
+
+#define TEST_SERIALIZE_NUMBER(expect, number) \
+  EXPECT_EQ(Json(number).serialize(), expect)
+
+TEST(Serialize, Number) {
+  TEST_SERIALIZE_NUMBER("0", 0.0);
+  TEST_SERIALIZE_NUMBER("-0", -0.0);
+  TEST_SERIALIZE_NUMBER("123456789012345", 123456789012345.0);
+  TEST_SERIALIZE_NUMBER("-42", -42.0);
+  // Shortest text that reads back as the same double.
+  TEST_SERIALIZE_NUMBER("0.1", 0.1);
+  TEST_SERIALIZE_NUMBER("0.30000000000000004", 0.1 + 0.2);
+  TEST_SERIALIZE_NUMBER("1.5", 1.5);
+  TEST_SERIALIZE_NUMBER("-3.25", -3.25);
+  TEST_SERIALIZE_NUMBER("1234567.25", 1234567.25);
+  TEST_SERIALIZE_NUMBER("0.0001", 0.0001);
+  TEST_SERIALIZE_NUMBER("1e-05", 0.00001);
+  TEST_SERIALIZE_NUMBER("1e+15", 1e15);
+  TEST_SERIALIZE_NUMBER("1e+20", 1e20);
+  TEST_SERIALIZE_NUMBER("1.2345e+300", 1.2345e300);
+  TEST_SERIALIZE_NUMBER("5e-324", 4.9406564584124654e-324);
+  TEST_SERIALIZE_NUMBER("2.2250738585072014e-308", 2.2250738585072014e-308);
+  TEST_SERIALIZE_NUMBER("1.7976931348623157e+308", 1.7976931348623157e308);
+  TEST_SERIALIZE_NUMBER("9.007199254740992e+15", 9007199254740992.0);
+}
+
+TEST(Serialize, Parallel) {
+  Json::array rows;
+  for (int i = 0; i != 5000; ++i) {
+    const std::string name = "r\xC3\xA9" + std::to_string(i);
+    rows.emplace_back(Json::object{{"id", Json(i)},
+                                   {"name", Json(name)},
+                                   {"tags", Json(Json::array{Json(i * 0.5)})}});
+  }
+  Json::object wide;
+  for (int i = 0; i != 3000; ++i) wide["k" + std::to_string(i)] = Json(i);
+  // Large containers at the root, below it and in small ones.
+  const Json docs[] = {Json(rows), Json(wide),
+                       Json(Json::object{{"rows", Json(rows)},
+                                         {"meta", Json(wide)}}),
+                       Json(Json::array{Json(1), Json(rows)}),
+                       Json(Json::array()), Json(3)};
+  for (const auto &json: docs) {
+    for (bool asciiOnly: {false, true}) {
+      SerializeOptions options;
+      options.compact = asciiOnly;
+      options.asciiOnly = asciiOnly;
+      const auto expect = json.serialize(options);
+      options.threads = 4;
+      EXPECT_EQ(json.serialize(options), expect);
+      options.threads = 0;
+      EXPECT_EQ(json.serialize(options), expect);
+    }
+  }
+
+  // Many medium containers below a small one, all written by one set of
+  // threads.
+  Json::array medium;
+  for (int i = 0; i != 50; ++i)
+    medium.emplace_back(Json::array(1100 + i, Json(i)));
+  SerializeOptions options;
+  const auto expect = Json(medium).serialize(options);
+  options.threads = 4;
+  EXPECT_EQ(Json(medium).serialize(options), expect);
+
+  // What a thread throws reaches the caller, once every thread is done.
+  rows[3000] = Json(std::string(1 << 20, 'x'));
+  const Json large(rows);
+  mayFailAllocations = false;
+  failAllocationsFrom = 1 << 20;
+  EXPECT_THROW(large.serialize(options), std::bad_alloc);
+  failAllocationsFrom = 0;
+  mayFailAllocations = true;
+  EXPECT_EQ(large.serialize(options).size(),
+            large.serialize(SerializeOptions()).size());
+}
+
+TEST(Json, Integer) {
+  std::string err;
+  // Beyond 2^53, doubles would round these.
+  auto json = Json::parse(
+      "[9007199254740993, -9223372036854775808, 18446744073709551615, "
+      "18446744073709551616, -0, 3.0, 1e2]", err);
+  EXPECT_EQ(err, "");
+  EXPECT_EQ(json[0].toInt64(), 9007199254740993);
+  EXPECT_EQ(json[1].toInt64(), std::numeric_limits<int64_t>::min());
+  EXPECT_EQ(json[2].toUint64(), std::numeric_limits<uint64_t>::max());
+  EXPECT_ANY_THROW(json[2].toInt64());
+  EXPECT_ANY_THROW(json[1].toUint64());
+  // Too large for 64 bits, so it is a double.
+  EXPECT_ANY_THROW(json[3].toUint64());
+  EXPECT_EQ(json[3].toNumber(), 18446744073709551616.0);
+  EXPECT_EQ(json[5].toInt64(), 3);
+  EXPECT_EQ(json[6].toUint64(), 100u);
+  EXPECT_EQ(json.serialize(true),
+            "[9007199254740993,-9223372036854775808,18446744073709551615,"
+            "1.8446744073709552e+19,-0,3,100]");
+  EXPECT_EQ(Json(1 << 30).serialize(), "1073741824");
+  EXPECT_EQ(Json(-(int64_t{1} << 62)).toInt64(), -(int64_t{1} << 62));
+  EXPECT_ANY_THROW(Json(0.5).toInt64());
+  EXPECT_ANY_THROW(Json("1").toInt64());
+
+  // Numbers are equal by value, whatever they are stored as, and hash alike.
+  EXPECT_EQ(Json(3), Json(3.0));
+  EXPECT_EQ(Json(3u), Json(3));
+  EXPECT_EQ(json[4], Json(0));
+  EXPECT_EQ(Json(3).hash(), Json(3.0).hash());
+  EXPECT_EQ(Json(0).hash(), Json(-0.0).hash());
+  EXPECT_EQ(Json(uint64_t{1} << 63).hash(), Json(9223372036854775808.0).hash());
+  EXPECT_FALSE(json[0] == Json(9007199254740992.0));
+  EXPECT_FALSE(Json(-1) == Json(std::numeric_limits<uint64_t>::max()));
+}
+
+TEST(Json, RawNumbers) {
+  ParseOptions options;
+  options.rawNumbers = true;
+  std::string err;
+  const std::string text = "[1.50,-0.0e0,1E400,123456789012345678901234567890]";
+  auto json = Json::parse(text, err, options);
+  EXPECT_EQ(err, "");
+  // Written back exactly as read.
+  EXPECT_EQ(json.serialize(true), text);
+  EXPECT_EQ(json[0].toNumber(), 1.5);
+  EXPECT_EQ(json[0], Json(1.5));
+  EXPECT_EQ(json[1], Json(0));
+  EXPECT_EQ(json[1].hash(), Json(0).hash());
+  EXPECT_EQ(json[2].toNumber(), HUGE_VAL);
+  EXPECT_ANY_THROW(json[3].toInt64());
+  // Copies keep the text.
+  Json copy = json;
+  EXPECT_EQ(copy.serialize(true), text);
+  EXPECT_EQ(Json::parse("1", err, options).toUint64(), 1u);
+}
+
 TEST(ParseError, InvalidValue) {
   TEST_ERROR("Invalid value", "nul");
   TEST_ERROR("Invalid value", "?");
@@ -432,6 +846,1202 @@ TEST(Json, Constructor) {
   EXPECT_TRUE(json["world"].isString());
 }
 
+TEST(Json, ArrayMutation) {
+  Json json = Json::array{};
+  json.push_back(Json(1));
+  Json str("moved");
+  json.push_back(std::move(str));
+  json.emplace_back(Json::object{{"a", true}});
+  json.insert(0, Json(nullptr));
+  json.insert(4, Json("end"));
+  EXPECT_EQ(json.serialize(true), "[null,1,\"moved\",{\"a\":true},\"end\"]");
+  json.erase(1);
+  json.erase(3);
+  EXPECT_EQ(json.serialize(true), "[null,\"moved\",{\"a\":true}]");
+  json[2].insert_or_assign("b", Json::array{});
+  json[2]["b"].push_back(Json(2));
+  EXPECT_EQ(json[2]["b"].serialize(), "[2]");
+  EXPECT_THROW(json.insert(4, Json(0)), std::runtime_error);
+  EXPECT_THROW(json.erase(3), std::runtime_error);
+  EXPECT_THROW(json.insert("key", Json(0)), std::runtime_error);
+  json.clear();
+  EXPECT_EQ(json.size(), 0);
+}
+
+TEST(Json, ObjectMutation) {
+  Json json = Json::object{};
+  EXPECT_TRUE(json.insert("a", Json(1)));
+  EXPECT_FALSE(json.insert("a", Json(2)));
+  EXPECT_EQ(json["a"].toNumber(), 1);
+  EXPECT_TRUE(json.emplace("b", "str"));
+  EXPECT_FALSE(json.emplace("b", 3.0));
+  EXPECT_EQ(json["b"].toString(), "str");
+  json.insert_or_assign("a", Json(2)) = Json(false);
+  EXPECT_EQ(json["a"], Json(false));
+  EXPECT_EQ(json.erase("a"), 1);
+  EXPECT_EQ(json.erase("a"), 0);
+  EXPECT_EQ(json.size(), 1);
+  EXPECT_THROW(json.push_back(Json(0)), std::runtime_error);
+  json.clear();
+  EXPECT_EQ(json.size(), 0);
+}
+
+TEST(Json, Find) {
+  Json json = Json::object{{"id", Json(1)},
+                           {std::string(64, 'k'), Json("long")}};
+  const Json &constJson = json;
+  ASSERT_NE(constJson.find("id"), nullptr);
+  EXPECT_EQ(*constJson.find("id"), Json(1));
+  EXPECT_EQ(constJson.find("missing"), nullptr);
+  EXPECT_EQ(constJson.find("idx", 2)->toInt64(), 1);
+  const std::string key(64, 'k');
+  EXPECT_EQ(constJson.find(key.c_str(), key.size())->toString(), "long");
+  // A literal key goes through the same lookup, and still throws on a miss.
+  EXPECT_EQ(constJson["id"], Json(1));
+  EXPECT_THROW(constJson["missing"], std::runtime_error);
+  char buffer[16] = "id";
+  EXPECT_EQ(constJson[buffer], Json(1));
+  // Writes through find() are seen by hash() and by copies sharing nodes.
+  const size_t hash = json.hash();
+  Json copy = json;
+  json.compact();
+  *json.find("id") = Json(2);
+  EXPECT_NE(json.hash(), hash);
+  EXPECT_EQ(copy["id"], Json(1));
+  EXPECT_THROW(Json(1).find("id"), std::runtime_error);
+}
+
+#define TEST_MERGE_PATCH(expect, target, patch) \
+  do {                                          \
+    auto json = assertParseSuccess(target);     \
+    json.mergePatch(assertParseSuccess(patch)); \
+    EXPECT_EQ(assertParseSuccess(expect), json); \
+  } while (0)
+
+// RFC 7386, Appendix A.
+TEST(Patch, MergePatch) {
+  TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":\"b\"}", "{\"a\":\"c\"}");
+  TEST_MERGE_PATCH("{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":\"b\"}",
+                   "{\"b\":\"c\"}");
+  TEST_MERGE_PATCH("{}", "{\"a\":\"b\"}", "{\"a\":null}");
+  TEST_MERGE_PATCH("{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}",
+                   "{\"a\":null}");
+  TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":\"c\"}");
+  TEST_MERGE_PATCH("{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":[\"b\"]}");
+  TEST_MERGE_PATCH("{\"a\":{\"b\":\"d\"}}",
+                   "{\"a\":{\"b\":\"c\"}}",
+                   "{\"a\":{\"b\":\"d\",\"c\":null}}");
+  TEST_MERGE_PATCH("{\"a\":[1]}", "{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}");
+  TEST_MERGE_PATCH("[\"c\",\"d\"]", "[\"a\",\"b\"]", "[\"c\",\"d\"]");
+  TEST_MERGE_PATCH("[\"c\"]", "{\"a\":\"b\"}", "[\"c\"]");
+  TEST_MERGE_PATCH("null", "{\"a\":\"foo\"}", "null");
+  TEST_MERGE_PATCH("\"bar\"", "{\"a\":\"foo\"}", "\"bar\"");
+  TEST_MERGE_PATCH("{\"e\":null,\"a\":1}", "{\"e\":null}", "{\"a\":1}");
+  TEST_MERGE_PATCH("{\"a\":{\"bb\":{}}}", "[1,2]",
+                   "{\"a\":{\"bb\":{\"ccc\":null}}}");
+  // The rvalue overload moves members out of the patch.
+  auto json = assertParseSuccess("{\"a\":{\"b\":1}}");
+  json.mergePatch(assertParseSuccess("{\"a\":{\"c\":[true]},\"d\":\"e\"}"));
+  EXPECT_EQ(json, assertParseSuccess(
+      "{\"a\":{\"b\":1,\"c\":[true]},\"d\":\"e\"}"));
+}
+
+#define TEST_PATCH(expect, target, patch)                    \
+  do {                                                       \
+    auto json = assertParseSuccess(target);                  \
+    std::string errMsg;                                      \
+    EXPECT_TRUE(json.applyPatch(assertParseSuccess(patch), errMsg)); \
+    EXPECT_EQ(errMsg, "");                                   \
+    EXPECT_EQ(assertParseSuccess(expect), json);             \
+  } while (0)
+
+#define TEST_PATCH_ERROR(expect, target, patch)              \
+  do {                                                       \
+    auto json = assertParseSuccess(target);                  \
+    std::string errMsg;                                      \
+    EXPECT_FALSE(json.applyPatch(assertParseSuccess(patch), errMsg)); \
+    EXPECT_EQ(expect, errMsg.substr(0, errMsg.find_first_of(":"))); \
+  } while (0)
+
+// RFC 6902, Appendix A.
+TEST(Patch, JsonPatch) {
+  TEST_PATCH("{\"baz\":\"qux\",\"foo\":\"bar\"}", "{\"foo\":\"bar\"}",
+             "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]");
+  TEST_PATCH("{\"foo\":[\"bar\",\"qux\",\"baz\"]}",
+             "{\"foo\":[\"bar\",\"baz\"]}",
+             "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]");
+  TEST_PATCH("{\"foo\":\"bar\"}", "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+             "[{\"op\":\"remove\",\"path\":\"/baz\"}]");
+  TEST_PATCH("{\"foo\":[\"bar\",\"baz\"]}",
+             "{\"foo\":[\"bar\",\"qux\",\"baz\"]}",
+             "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]");
+  TEST_PATCH("{\"baz\":\"boo\",\"foo\":\"bar\"}",
+             "{\"baz\":\"qux\",\"foo\":\"bar\"}",
+             "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]");
+  TEST_PATCH("{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\","
+             "\"thud\":\"fred\"}}",
+             "{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},"
+             "\"qux\":{\"corge\":\"grault\"}}",
+             "[{\"op\":\"move\",\"from\":\"/foo/waldo\","
+             "\"path\":\"/qux/thud\"}]");
+  TEST_PATCH("{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}",
+             "{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}",
+             "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]");
+  TEST_PATCH("{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+             "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+             "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},"
+             "{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]");
+  TEST_PATCH("{\"foo\":\"bar\",\"child\":{\"grandchild\":{}}}",
+             "{\"foo\":\"bar\"}",
+             "[{\"op\":\"add\",\"path\":\"/child\","
+             "\"value\":{\"grandchild\":{}}}]");
+  TEST_PATCH("{\"foo\":[\"bar\",[\"abc\",\"def\"]]}", "{\"foo\":[\"bar\"]}",
+             "[{\"op\":\"add\",\"path\":\"/foo/-\","
+             "\"value\":[\"abc\",\"def\"]}]");
+  TEST_PATCH("{\"/\":9,\"~1\":10,\"~\":1}", "{\"/\":9,\"~1\":10}",
+             "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":10},"
+             "{\"op\":\"copy\",\"from\":\"/~1\",\"path\":\"/~0\"},"
+             "{\"op\":\"replace\",\"path\":\"/~0\",\"value\":1}]");
+  TEST_PATCH("[1]", "{\"a\":[1]}",
+             "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"\"}]");
+  TEST_PATCH_ERROR("Path not found", "{\"foo\":\"bar\"}",
+                   "[{\"op\":\"add\",\"path\":\"/baz/bat\","
+                   "\"value\":\"qux\"}]");
+  TEST_PATCH_ERROR("Test failed", "{\"baz\":\"qux\"}",
+                   "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]");
+  TEST_PATCH_ERROR("Test failed", "{\"/\":9,\"~1\":10}",
+                   "[{\"op\":\"test\",\"path\":\"/~01\",\"value\":\"10\"}]");
+  TEST_PATCH_ERROR("Invalid index", "{\"foo\":[\"bar\"]}",
+                   "[{\"op\":\"add\",\"path\":\"/foo/2\",\"value\":1}]");
+  TEST_PATCH_ERROR("Invalid index", "[1]",
+                   "[{\"op\":\"remove\",\"path\":\"/01\"}]");
+  // 100000 * 2^64 + 1, which must not wrap around to 1.
+  TEST_PATCH_ERROR("Invalid index", "[1,2]",
+                   "[{\"op\":\"remove\","
+                   "\"path\":\"/1844674407370955161600001\"}]");
+  TEST_PATCH_ERROR("Invalid pointer", "{}",
+                   "[{\"op\":\"add\",\"path\":\"a\",\"value\":1}]");
+  TEST_PATCH_ERROR("Unknown patch operation", "{}",
+                   "[{\"op\":\"frob\",\"path\":\"\"}]");
+  TEST_PATCH_ERROR("Patch operation is missing \"value\"", "{}",
+                   "[{\"op\":\"add\",\"path\":\"/a\"}]");
+  TEST_PATCH_ERROR("Cannot move a value into itself", "{\"a\":{}}",
+                   "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b\"}]");
+  // A move to a missing path leaves the source where it was.
+  for (const char *from: {"/a", "/b/1"}) {
+    auto json = assertParseSuccess("{\"a\":{\"x\":1},\"b\":[1,2,3]}");
+    const auto original = json;
+    std::string errMsg;
+    EXPECT_FALSE(json.applyPatch(
+        Json(Json::array{Json(Json::object{{"op", Json("move")},
+                                           {"from", Json(from)},
+                                           {"path", Json("/missing/x")}})}),
+        errMsg));
+    EXPECT_EQ(errMsg, "Path not found: /missing/x");
+    EXPECT_EQ(json, original);
+  }
+}
+
+TEST(Json, Hash) {
+  auto json = assertParseSuccess(
+      "{\"a\": [1, -0, \"x\"], \"b\": {\"c\": null, \"d\": true}}");
+  auto json2 = assertParseSuccess(
+      "{\"b\": {\"d\": true, \"c\": null}, \"a\": [1, 0, \"x\"]}");
+  EXPECT_EQ(json.hash(), json2.hash());
+  EXPECT_EQ(json, json2);
+  EXPECT_NE(Json(Json::array{}).hash(), Json(Json::object{}).hash());
+  EXPECT_NE(Json("").hash(), Json(Json::array{}).hash());
+  EXPECT_NE(assertParseSuccess("[1, 2]").hash(),
+            assertParseSuccess("[2, 1]").hash());
+  // Mutating through the root drops the cached hashes on the way down.
+  const auto before = json.hash();
+  json["b"]["d"] = Json(false);
+  EXPECT_NE(json.hash(), before);
+  EXPECT_FALSE(json == json2);
+  json["b"]["d"] = Json(true);
+  EXPECT_EQ(json.hash(), before);
+  json["a"].push_back(Json(1));
+  EXPECT_NE(json.hash(), before);
+  json["a"].erase(3);
+  EXPECT_EQ(json.hash(), before);
+  EXPECT_EQ(json, json2);
+}
+
+TEST(Json, Diff) {
+  auto from = assertParseSuccess(
+      "{\"same\": {\"x\": [1, 2]}, \"num\": 1, \"gone\": null, "
+      "\"arr\": [1, 2, 3], \"a/b\": {\"c~d\": 1}, \"type\": []}");
+  auto to = assertParseSuccess(
+      "{\"same\": {\"x\": [1, 2]}, \"num\": 2, \"new\": true, "
+      "\"arr\": [1, 5], \"a/b\": {\"c~d\": 2}, \"type\": {}}");
+  auto paths = Json::diff(from, to);
+  std::sort(paths.begin(), paths.end());
+  EXPECT_EQ(paths, (std::vector<std::string>{
+      "/arr/1", "/arr/2", "/a~1b/c~0d", "/gone", "/new", "/num", "/type"}));
+  EXPECT_TRUE(Json::diff(from, from).empty());
+  EXPECT_EQ(Json::diff(Json(1), Json("1")), std::vector<std::string>{""});
+
+  // A child modified through a reference taken before hash() leaves its
+  // parents' hashes stale. Equality and diff() still see the real values.
+  auto stale = assertParseSuccess("{\"a\": {\"b\": 1}}");
+  const auto one = assertParseSuccess("{\"a\": {\"b\": 1}}");
+  const auto two = assertParseSuccess("{\"a\": {\"b\": 2}}");
+  Json &b = stale["a"]["b"];
+  EXPECT_EQ(stale.hash(), one.hash());
+  b = Json(2);
+  two.hash();
+  EXPECT_EQ(stale, two);
+  EXPECT_FALSE(stale == one);
+  EXPECT_TRUE(Json::diff(stale, two).empty());
+  EXPECT_EQ(Json::diff(stale, one), std::vector<std::string>{"/a/b"});
+}
+
+TEST(Json, Deduplicate) {
+  const std::string jsonString =
+      "[{\"unit\": {\"name\": \"kg\", \"scale\": 1000}, \"tags\": [], "
+      "\"n\": \"kg\"}, "
+      "{\"unit\": {\"name\": \"kg\", \"scale\": 1000}, \"tags\": [], "
+      "\"n\": \"kg\"}, "
+      "{\"unit\": {\"scale\": 1000, \"name\": \"kg\"}, \"tags\": []}]";
+  std::string errMsg;
+  ParseOptions options;
+  options.deduplicate = true;
+  auto json = Json::parse(jsonString, errMsg, options);
+  EXPECT_EQ(errMsg, "");
+  EXPECT_EQ(json, assertParseSuccess(jsonString));
+  // Identical subtrees share one node, so their children live at the same
+  // address. Only const access keeps them shared.
+  const Json &shared = json;
+  EXPECT_EQ(&shared[0]["unit"], &shared[1]["unit"]);
+  EXPECT_EQ(&shared[0]["unit"]["name"], &shared[2]["unit"]["name"]);
+  // Modifying one of them copies it first.
+  json[1]["unit"]["name"] = Json("g");
+  EXPECT_EQ(shared[0]["unit"]["name"].toString(), "kg");
+  EXPECT_EQ(shared[1]["unit"]["name"].toString(), "g");
+  EXPECT_EQ(shared[2]["unit"]["name"].toString(), "kg");
+  EXPECT_NE(&shared[0]["unit"], &shared[1]["unit"]);
+  EXPECT_EQ(&shared[0]["unit"]["name"], &shared[2]["unit"]["name"]);
+  json[2]["tags"].push_back(Json(1));
+  EXPECT_EQ(shared[0]["tags"].size(), 0);
+  EXPECT_EQ(shared[2]["tags"].size(), 1);
+}
+
+TEST(Json, Compact) {
+  auto json = assertParseSuccess(
+      "{\"a\": {\"x\": [1, 2], \"y\": \"s\"}, \"b\": {\"y\": \"s\", "
+      "\"x\": [1, 2]}, \"c\": [[1, 2], \"s\"]}");
+  const auto expect = json;
+  json.compact();
+  EXPECT_EQ(json, expect);
+  const Json &shared = json;
+  EXPECT_EQ(&shared["a"]["x"][0], &shared["b"]["x"][0]);
+  EXPECT_EQ(&shared["a"]["x"][0], &shared["c"][0][0]);
+  // Copies keep sharing the nodes that are shared already.
+  const Json copy = json;
+  EXPECT_EQ(&copy["a"]["x"][0], &shared["b"]["x"][0]);
+  json["b"]["x"].erase(0);
+  EXPECT_EQ(shared["a"]["x"].size(), 2);
+  EXPECT_EQ(shared["b"]["x"].size(), 1);
+  EXPECT_EQ(copy, expect);
+}
+
+TEST(ParserContext, Reuse) {
+  const std::string docs[] = {
+      "{\"id\": 1, \"tags\": [\"a long enough tag value\", \"b\"], "
+      "\"meta\": {\"k\": null, \"e\": \"\\u00e9\\ud834\\udd1e\"}}",
+      "{\"id\": 2, \"tags\": [\"another long tag value\", true, false, "
+      "[]], \"meta\": {}}",
+      "[1, \"x\", [2, [3, {\"y\": \"a string that is not short\"}]]]",
+  };
+  ParserContext context;
+  Json kept;
+  for (int round = 0; round != 3; ++round) {
+    for (const auto &doc: docs) {
+      std::string err;
+      auto json = context.parse(doc, err);
+      EXPECT_TRUE(err.empty());
+      EXPECT_EQ(json, Json::parse(doc, err));
+      if (round == 0) kept = json;
+      context.recycle(std::move(json));
+    }
+  }
+  // |kept| was still shared when recycled, so it must be intact.
+  std::string err;
+  EXPECT_EQ(kept, Json::parse(docs[2], err));
+  std::string ctxErr;
+  context.parse("[1, 2", ctxErr);
+  Json::parse("[1, 2", err);
+  EXPECT_EQ(ctxErr, err);
+
+  // One large document is not reserved for in the small ones after it.
+  std::string big = "[\"a\"", bigObject = "{\"k0\": 0";
+  for (int i = 1; i != 100000; ++i) {
+    big += ", \"a\"";
+    bigObject += ", \"k" + std::to_string(i) + "\": 0";
+  }
+  EXPECT_EQ(context.parse(big + "]", err).size(), 100000);
+  EXPECT_EQ(context.parse(bigObject + "}", err).size(), 100000);
+  EXPECT_LT(context.parse("[\"a\"]", err).memoryUsage().slack,
+            64 * sizeof(void *));
+  EXPECT_LT(context.parse("{\"k\": 0}", err).memoryUsage().slack,
+            64 * sizeof(void *));
+}
+
+TEST(ParserContext, OutlivesContext) {
+  Json json;
+  {
+    ParserContext context;
+    std::string err;
+    json = context.parse("{\"a\": [1, 2, {\"b\": \"c\"}]}", err);
+  }
+  EXPECT_EQ(json["a"][2]["b"].toString(), "c");
+  json["a"].push_back(3);
+  EXPECT_EQ(json.serialize(true), "{\"a\":[1,2,{\"b\":\"c\"},3]}");
+}
+
+TEST(Snapshot, Read) {
+  auto json = assertParseSuccess("{\"a\": [1, {\"b\": \"c\"}], \"d\": null}");
+  const auto expect = json;
+  auto snapshot = JsonSnapshot::create(std::move(json));
+  EXPECT_EQ(snapshot->root(), expect);
+  EXPECT_EQ(snapshot->hash(), expect.hash());
+  EXPECT_EQ((*snapshot)["a"][1]["b"].toString(), "c");
+  // Copies out of a snapshot are ordinary values.
+  auto copy = snapshot->root();
+  copy["a"].push_back(2);
+  EXPECT_EQ(snapshot->root(), expect);
+  EXPECT_EQ(copy["a"].size(), 3);
+}
+
+// Compacting a copy leaves the nodes it shares with the snapshot alone, while
+// other threads read them.
+TEST(Snapshot, CompactCopy) {
+  const std::string text =
+      "[{\"k\": [\"shared\", {\"n\": 1}]}, {\"k\": [\"shared\", {\"n\": 1}]}]";
+  std::string err;
+  ParseOptions options;
+  options.deduplicate = true;
+  const auto expect = assertParseSuccess(text);
+  const auto snapshot = JsonSnapshot::create(Json::parse(text, err, options));
+  std::atomic<bool> done(false);
+  bool consistent = true;
+  std::thread reader([&snapshot, &expect, &done, &consistent] {
+    while (!done) {
+      if (!(snapshot->root() == expect)
+          || Json::diff(snapshot->root(), expect).size())
+        consistent = false;
+    }
+  });
+  auto expectCopy = expect;
+  expectCopy.insert(0, Json("shared"));
+  expectCopy.insert(0, assertParseSuccess("{\"n\": 1}"));
+  for (int i = 0; i != 200; ++i) {
+    // New values equal to the ones inside the shared nodes come first, so
+    // they are what the shared nodes' children would be interned to.
+    auto copy = snapshot->root();
+    copy.insert(0, Json("shared"));
+    copy.insert(0, assertParseSuccess("{\"n\": 1}"));
+    copy.compact();
+    EXPECT_EQ(copy, expectCopy);
+  }
+  done = true;
+  reader.join();
+  EXPECT_TRUE(consistent);
+  EXPECT_EQ(snapshot->root(), expect);
+}
+
+// The elements of packed arrays are built on first access, already hashed,
+// so diff() and hash() on them never write to shared nodes.
+TEST(Snapshot, PackedDiff) {
+  std::string err;
+  const auto from = JsonSnapshot::create(
+      Json::parse("{\"a\": [1, 2, 3.5, 4], \"b\": [true, false]}", err));
+  const auto to = JsonSnapshot::create(
+      Json::parse("{\"a\": [1, 2, 3.5, 5], \"b\": [true, true]}", err));
+  ASSERT_NE((*from)["a"].packedNumbers(), nullptr);
+  std::vector<std::thread> threads;
+  std::atomic<int> mismatches(0);
+  for (int t = 0; t != 4; ++t) {
+    threads.emplace_back([&from, &to, &mismatches] {
+      for (int i = 0; i != 200; ++i) {
+        auto paths = Json::diff(from->root(), to->root());
+        std::sort(paths.begin(), paths.end());
+        if (paths != std::vector<std::string>{"/a/3", "/b/1"}
+            || (*from)["a"][2].hash() != Json(3.5).hash())
+          ++mismatches;
+      }
+    });
+  }
+  for (auto &thread: threads) thread.join();
+  EXPECT_EQ(mismatches, 0);
+}
+
+TEST(Snapshot, Publish) {
+  // Built up front, so that publish() races the readers as often as it can.
+  std::vector<JsonSnapshot::Ptr> versions;
+  for (int version = 1; version != 2000; ++version) {
+    Json::object obj;
+    obj["version"] = Json(version);
+    obj["check"] = Json(Json::array{Json(version)});
+    versions.push_back(JsonSnapshot::create(Json(std::move(obj))));
+  }
+  AtomicSnapshot current(JsonSnapshot::create(
+      assertParseSuccess("{\"version\": 0, \"check\": [0]}")));
+  std::weak_ptr<const JsonSnapshot> first = current.load();
+  std::vector<std::thread> readers;
+  std::atomic<bool> published{false};
+  bool consistent = true;
+  std::mutex mutex;
+  for (int i = 0; i != 4; ++i) {
+    readers.emplace_back([&current, &published, &consistent, &mutex] {
+      double last = 0;
+      while (!published) {
+        const auto snapshot = current.load();
+        const auto &root = snapshot->root();
+        // Never an older snapshot than one loaded before.
+        const double version = root["version"].toNumber();
+        if (version < last || version != root["check"][0].toNumber()
+            || root.hash() != snapshot->hash()) {
+          std::lock_guard<std::mutex> lock(mutex);
+          consistent = false;
+        }
+        last = version;
+      }
+    });
+  }
+  for (auto &version: versions) current.publish(std::move(version));
+  published = true;
+  for (auto &t: readers) t.join();
+  EXPECT_TRUE(consistent);
+  EXPECT_EQ(current.reclaim(), 0);
+  EXPECT_TRUE(first.expired());
+  EXPECT_EQ(current.load()->root()["version"].toNumber(), 1999);
+}
+
+TEST(Json, Projection) {
+  Projection projection{"id", "user.name", "items.price", "tags"};
+  ParseOptions options;
+  options.projection = &projection;
+  std::string err;
+  auto json = Json::parse(
+      "{\"id\": 7, \"blob\": {\"a\": [1, {\"b\": \"}]\\\"\"}], \"c\": null},"
+      " \"user\": {\"name\": \"x\", \"bio\": \"[{\"},"
+      " \"items\": [{\"price\": 1, \"sku\": \"a\"}, {\"sku\": \"b\"}, 3],"
+      " \"tags\": [\"t\", {\"k\": 1}], \"ts\": 1.5}", err, options);
+  EXPECT_EQ(err, "");
+  EXPECT_EQ(json.serialize(true), Json::parse(
+      "{\"id\":7,\"user\":{\"name\":\"x\"},"
+      "\"items\":[{\"price\":1},{},3],\"tags\":[\"t\",{\"k\":1}]}",
+      err).serialize(true));
+
+  // Skipped values still have to end.
+  for (const char *text: {"{\"a\": [1, 2}", "{\"a\": \"abc}", "{\"a\": }",
+                          "{\"a\": 1,}", "{\"a\": 1 \"id\": 2}"}) {
+    err.clear();
+    Json::parse(text, err, options);
+    EXPECT_NE(err, "") << text;
+  }
+  // The projection is applied with a context as well.
+  ParserContext context;
+  EXPECT_EQ(context.parse("{\"id\": 1, \"x\": 2}", err, options).size(), 1);
+}
+
+TEST(Columns, Extract) {
+  Columns columns;
+  columns.add("ts", ColumnType::kInt64);
+  columns.add("v", ColumnType::kDouble);
+  columns.add("ok", ColumnType::kBool);
+  columns.add("name", ColumnType::kString);
+  std::string text = "[";
+  for (int i = 0; i != 100; ++i) {
+    if (i) text += ", ";
+    text += "{\"ts\": " + std::to_string(1000 + i)
+        + ", \"skip\": {\"a\": [\"]\"]}, \"v\": " + std::to_string(i) + ".5";
+    if (i % 3) text += ", \"ok\": " + std::string(i % 2 ? "true" : "false");
+    if (i % 5) text += ", \"name\": \"n\\u00e9" + std::to_string(i) + "\"";
+    else text += ", \"name\": null";
+    text += "}";
+  }
+  text += "]";
+  std::string err;
+  for (int pass = 0; pass != 2; ++pass) {
+    const bool ok = pass == 0 ? columns.extract(text, err)
+                              : columns.extract(Json::parse(text, err), err);
+    ASSERT_TRUE(ok) << err;
+    ASSERT_EQ(columns.rows(), 100);
+    EXPECT_EQ(columns[0].ints[99], 1099);
+    EXPECT_EQ(columns[1].doubles[7], 7.5);
+    EXPECT_EQ(columns.find("ok")->nullCount, 34);
+    EXPECT_TRUE(columns[2].isNull(3));
+    EXPECT_FALSE(columns[2].isNull(65));
+    EXPECT_EQ(columns[2].bools[65], 1);
+    EXPECT_EQ(columns[3].nullCount, 20);
+    EXPECT_TRUE(columns[3].isNull(5));
+    EXPECT_EQ(columns[3].stringAt(5), "");
+    EXPECT_EQ(columns[3].stringAt(6), "n\xC3\xA9" "6");
+    EXPECT_EQ(columns[3].offsets.size(), 101);
+  }
+
+  // The last of duplicate keys wins, as in parse().
+  ASSERT_TRUE(columns.extract(
+      "[{\"name\": \"a\", \"name\": null, \"v\": 1, \"v\": 2}]", err));
+  EXPECT_EQ(columns[3].chars, "");
+  EXPECT_EQ(columns[3].nullCount, 1);
+  EXPECT_EQ(columns[1].doubles, std::vector<double>{2});
+  EXPECT_EQ(columns[0].nullCount, 1);
+  ASSERT_TRUE(columns.extract("[]", err));
+  EXPECT_EQ(columns.rows(), 0);
+
+  for (const char *bad: {"{}", "[1]", "[{\"v\": \"1\"}]", "[{\"ts\": 1.5}]",
+                         "[{\"ok\": 1}]", "[{\"v\": 1}", "[{\"v\": 1},]"}) {
+    err.clear();
+    EXPECT_FALSE(columns.extract(bad, err)) << bad;
+    EXPECT_NE(err, "");
+    EXPECT_EQ(columns.rows(), 0);
+  }
+  err.clear();
+  EXPECT_FALSE(columns.extract(Json::parse("[{\"ts\": 1.5}]", err), err));
+  EXPECT_EQ(err, "Number is not a 64-bit integer");
+}
+
+TEST(Json, PackedArray) {
+  std::string err;
+  auto numbers = Json::parse("[1, 2.5, -0, 3e2, -7]", err);
+  ASSERT_NE(numbers.packedNumbers(), nullptr);
+  EXPECT_EQ(*numbers.packedNumbers(),
+            (std::vector<double>{1, 2.5, -0.0, 300, -7}));
+  EXPECT_EQ(numbers.serialize(true), "[1,2.5,-0,300,-7]");
+  Json::array items{1, 2.5, -0.0, 300, -7};
+  EXPECT_EQ(numbers, Json(items));
+  EXPECT_EQ(numbers.hash(), Json(items).hash());
+  const Json &view = numbers;
+  EXPECT_EQ(view.size(), 5);
+  EXPECT_EQ(view[4].toInt64(), -7);
+  EXPECT_EQ(view.toArray()[1].toNumber(), 2.5);
+
+  // Copies stay packed, until a non-const accessor gets to the elements.
+  auto copy = numbers;
+  copy.push_back(Json(1));
+  EXPECT_EQ(copy.packedNumbers(), nullptr);
+  EXPECT_NE(numbers.packedNumbers(), nullptr);
+  EXPECT_EQ(copy.serialize(true), "[1,2.5,-0,300,-7,1]");
+
+  auto bools = Json::parse("[true, false, true]", err);
+  ASSERT_NE(bools.packedBools(), nullptr);
+  EXPECT_EQ(bools.serialize(true), "[true,false,true]");
+  EXPECT_EQ(bools, Json(Json::array{true, false, true}));
+  EXPECT_EQ(bools.hash(), Json(Json::array{true, false, true}).hash());
+
+  // Mixed arrays, and integers that would be written back differently.
+  for (const char *text: {"[1, true]", "[true, 1]", "[1, 2, null]",
+                          "[[1], 2]", "[1, 1000000000000000]", "[]"}) {
+    auto json = Json::parse(text, err);
+    EXPECT_EQ(err, "") << text;
+    EXPECT_EQ(json.packedNumbers(), nullptr) << text;
+    EXPECT_EQ(json.packedBools(), nullptr) << text;
+    EXPECT_EQ(json.serialize(true), Json::parse(text, err, [] {
+      ParseOptions options;
+      options.packArrays = false;
+      return options;
+    }()).serialize(true)) << text;
+  }
+  EXPECT_EQ(Json::parse("[1, 2, null]", err)[1].toInt64(), 2);
+  for (const char *bad: {"[1, tru]", "[1, 2", "[true, 01]", "[1e999]"}) {
+    err.clear();
+    Json::parse(bad, err);
+    EXPECT_NE(err, "") << bad;
+  }
+
+  ParseOptions options;
+  options.packArrays = false;
+  EXPECT_EQ(Json::parse("[1, 2]", err, options).packedNumbers(), nullptr);
+  ParserContext context;
+  for (int i = 0; i != 2; ++i) {
+    auto json = context.parse("{\"a\": [1, 2], \"b\": [[true]]}", err);
+    EXPECT_NE(json["a"].packedNumbers(), nullptr);
+    EXPECT_NE(json["b"][0].packedBools(), nullptr);
+  }
+}
+
+TEST(Json, MemoryUsage) {
+  std::string err;
+  const std::string text =
+      "{\"name\": \"" + std::string(100, 'n') + "\", \"ids\": [1, 2, 3],"
+      " \"tags\": [\"a\", null, true], \"nested\": {\"x\": 1.5}}";
+  auto json = Json::parse(text, err);
+  auto usage = json.memoryUsage();
+  EXPECT_GE(usage.strings, 101);
+  EXPECT_GT(usage.nodes[static_cast<size_t>(JsonType::kObject)], 0);
+  EXPECT_GT(usage.nodes[static_cast<size_t>(JsonType::kArray)], 0);
+  EXPECT_GT(usage.nodes[static_cast<size_t>(JsonType::kNull)], 0);
+  EXPECT_GT(usage.containers, 0);
+  EXPECT_GT(usage.total(), usage.strings + usage.containers);
+
+  // Slack left over from modification is given back.
+  Json::array items;
+  items.reserve(1000);
+  items.emplace_back(std::string(64, 's'));
+  json.insert_or_assign("items", Json(std::move(items)));
+  for (int i = 0; i != 100; ++i) json["nested"].insert(std::to_string(i), i);
+  for (int i = 0; i != 100; ++i) json["nested"].erase(std::to_string(i));
+  const size_t hash = json.hash();
+  usage = json.memoryUsage();
+  EXPECT_GE(usage.slack, 999 * sizeof(Json));
+  json.shrink();
+  const auto shrunk = json.memoryUsage();
+  EXPECT_LT(shrunk.slack, 64 * sizeof(void *));
+  EXPECT_LT(shrunk.total(), usage.total());
+  EXPECT_EQ(json.hash(), hash);
+  EXPECT_EQ(json["items"][0].toString(), std::string(64, 's'));
+
+  // Nodes shared within the tree are counted once.
+  const Json::array copies(4, Json(std::string(200, 'c')));
+  Json shared(copies);
+  const size_t before = shared.memoryUsage().strings;
+  shared.compact();
+  EXPECT_LT(shared.memoryUsage().strings, before);
+  EXPECT_GE(shared.memoryUsage().strings, 201);
+  // and not shrunk, but their parents are.
+  shared.shrink();
+  EXPECT_EQ(shared.serialize(), Json(copies).serialize());
+
+  // Packed arrays count the elements they have built.
+  const auto packed = Json::parse("[1, 2.5, 3]", err);
+  const size_t packedBytes = packed.memoryUsage().total();
+  EXPECT_EQ(packed[1].toNumber(), 2.5);
+  EXPECT_GT(packed.memoryUsage().total(), packedBytes);
+}
+
+TEST(StaticJson, Parse) {
+  static constexpr const char kText[] = R"({
+    "name": "server", "port": 8080, "ratio": 0.25, "big": 18446744073709551615,
+    "small": -9223372036854775808, "exp": 1.5e-7, "zero": -0,
+    "tls": {"enabled": false, "ciphers": ["a\tb", "é😀"]},
+    "empty": [{}, []], "none": null, "port": 8443
+  })";
+  static constexpr auto kConfig = LIGHTJSON_STATIC_JSON(kText);
+  // Read at compile time.
+  static_assert(kConfig["name"].toString() == "server");
+  static_assert(kConfig["port"].toInt64() == 8443);
+  static_assert(kConfig["ratio"].toNumber() == 0.25);
+  static_assert(kConfig["tls"]["ciphers"][1].toString() == "é\U0001F600");
+  static_assert(!kConfig["tls"]["enabled"].toBool());
+  static_assert(!kConfig.root().find("missing"));
+  static_assert(kConfig.root().size() == 10);
+
+  std::string err;
+  const auto json = Json::parse(kText, err);
+  EXPECT_EQ(kConfig.root().toJson(), json);
+  EXPECT_EQ(kConfig["big"].toUint64(), 18446744073709551615u);
+  EXPECT_EQ(kConfig["small"].toInt64(), INT64_MIN);
+  EXPECT_EQ(kConfig["exp"].toNumber(), 1.5e-7);
+  EXPECT_TRUE(std::signbit(kConfig["zero"].toNumber()));
+  EXPECT_EQ(kConfig.root().member(1).first, "ratio");
+  EXPECT_TRUE(kConfig["empty"][1].isArray());
+  EXPECT_THROW(kConfig["none"].toBool(), std::exception);
+  EXPECT_THROW(kConfig["missing"], std::exception);
+  EXPECT_THROW(kConfig["empty"][2], std::exception);
+
+  // Numbers that are read exactly match strtod().
+  static constexpr auto kNumbers = LIGHTJSON_STATIC_JSON(
+      "[0.1, 3.14159, 123456789012345678, 0.000001, 9007199254740993.0,"
+      " 1e22, 1e-22, 1234567890e3, 4.5e15, -2.5]");
+  const auto numbers = Json::parse(
+      "[0.1, 3.14159, 123456789012345678, 0.000001, 9007199254740993.0,"
+      " 1e22, 1e-22, 1234567890e3, 4.5e15, -2.5]", err);
+  EXPECT_EQ(kNumbers.root().toJson(), numbers);
+  EXPECT_EQ(kNumbers[4].toNumber(), 9007199254740992.0);
+  EXPECT_EQ(kNumbers[8].toInt64(), 4500000000000000);
+}
+
+TEST(JsonWriter, Write) {
+  std::string out = "prefix ";
+  JsonWriter writer(out);
+  writer.startObject();
+  writer.key("id").value(7);
+  writer.key("big").value(std::numeric_limits<uint64_t>::max());
+  writer.key("ratio").value(0.1);
+  writer.key(std::string("na\"me")).value("caf\xC3\xA9\n");
+  writer.key("tags").startArray().value("a").value(nullptr).value(true)
+      .startArray().endArray().startObject().endObject().endArray();
+  writer.key("nested").value(Json(Json::array{1, Json::object{{"k", false}}}));
+  EXPECT_FALSE(writer.done());
+  writer.endObject();
+  EXPECT_TRUE(writer.done());
+  EXPECT_EQ(out,
+            "prefix {\"id\": 7, \"big\": 18446744073709551615, \"ratio\": 0.1, "
+            "\"na\\\"me\": \"caf\xC3\xA9\\n\", "
+            "\"tags\": [\"a\", null, true, [], {}], "
+            "\"nested\": [1, {\"k\": false}]}");
+
+  SerializeOptions options;
+  options.compact = true;
+  options.asciiOnly = true;
+  out.clear();
+  JsonWriter compact(out, options);
+  compact.startArray().value("\xC3\xA9").value(-1).value(2.5).endArray();
+  EXPECT_EQ(out, "[\"\\u00e9\",-1,2.5]");
+  out.clear();
+  JsonWriter scalar(out);
+  scalar.value(-0.0);
+  EXPECT_TRUE(scalar.done());
+  EXPECT_EQ(out, "-0");
+}
+
+TEST(JsonWriter, Sink) {
+  std::string text;
+  size_t pieces = 0;
+  JsonWriter writer([&text, &pieces](const char *data, size_t size) {
+    text.append(data, size);
+    ++pieces;
+  }, 64);
+  writer.startArray();
+  for (int i = 0; i != 100; ++i)
+    writer.startObject().key("i").value(i).endObject();
+  EXPECT_GT(pieces, 1);
+  // The rest comes once the root is complete.
+  const size_t before = text.size();
+  writer.endArray();
+  EXPECT_GT(text.size(), before);
+  std::string err;
+  const auto json = Json::parse(text, err);
+  ASSERT_EQ(err, "");
+  ASSERT_EQ(json.size(), 100);
+  EXPECT_EQ(json[99]["i"].toInt64(), 99);
+}
+
+// Hands out |data| |step| bytes at a time.
+JsonStream::Source stringSource(std::string data, size_t step) {
+  auto pos = std::make_shared<size_t>(0);
+  return [data, step, pos](char *buf, size_t size) {
+    const size_t n = std::min({step, size, data.size() - *pos});
+    memcpy(buf, data.data() + *pos, n);
+    *pos += n;
+    return n;
+  };
+}
+
+#ifdef LIGHTJSON_WITH_ZLIB
+std::string gzip(const std::string &text) {
+  z_stream stream{};
+  // 16 on top of the window bits writes a gzip header.
+  deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&stream, text.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+  stream.avail_in = text.size();
+  stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  stream.avail_out = out.size();
+  deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+#endif
+
+#ifdef LIGHTJSON_WITH_ZSTD
+std::string zstd(const std::string &text) {
+  std::string out(ZSTD_compressBound(text.size()), '\0');
+  out.resize(ZSTD_compress(&out[0], out.size(), text.data(), text.size(), 1));
+  return out;
+}
+#endif
+
+std::vector<Json> readAll(JsonStream &stream, std::string &err) {
+  std::vector<Json> records;
+  Json record;
+  while (stream.next(record, err)) records.push_back(record);
+  return records;
+}
+
+TEST(JsonStream, Ndjson) {
+  StreamOptions options;
+  options.chunkSize = 7;
+  options.maxChunks = 1;
+  const std::string text =
+      "{\"id\": 1, \"tags\": [\"a\", \"b\"]}\n\n  \r\n[1, 2]\r\n\"x\"\n"
+      "{\"id\": 4}";
+  std::string err;
+  for (size_t step: {1, 3, 1000}) {
+    JsonStream stream(stringSource(text, step), options);
+    const auto records = readAll(stream, err);
+    EXPECT_EQ(err, "");
+    ASSERT_EQ(records.size(), 4);
+    EXPECT_EQ(records[0]["tags"][1].toString(), "b");
+    EXPECT_EQ(records[1].size(), 2);
+    EXPECT_EQ(records[2].toString(), "x");
+    EXPECT_EQ(records[3]["id"].toInt64(), 4);
+  }
+
+  JsonStream bad(stringSource("1\n2\n[3,\n4\n", 2), options);
+  EXPECT_EQ(readAll(bad, err).size(), 2);
+  EXPECT_EQ(err.substr(0, 8), "Line 3: ");
+  Json record;
+  err.clear();
+  EXPECT_FALSE(bad.next(record, err));
+  EXPECT_NE(err, "");
+
+  err.clear();
+  JsonStream document(stringSource("{\"a\":\n [1,\n 2]}", 2), options);
+  EXPECT_EQ(document.parse(err)["a"][1].toInt64(), 2);
+  EXPECT_EQ(err, "");
+
+  // Destroyed long before the end, while decompression waits for room.
+  std::string many;
+  for (int i = 0; i != 10000; ++i) many += std::to_string(i) + "\n";
+  {
+    JsonStream stream(stringSource(many, 100), options);
+    EXPECT_TRUE(stream.next(record, err));
+  }
+
+  // Destroyed while input trickles in and no chunk fills up: only the read
+  // in progress is waited for.
+  {
+    StreamOptions trickle;
+    trickle.chunkSize = 1 << 24;
+    std::atomic<size_t> reads{0};
+    {
+      JsonStream stream([&reads](char *buf, size_t) -> size_t {
+        ++reads;
+        *buf = ' ';
+        return 1;
+      }, trickle);
+      while (reads < 10) std::this_thread::yield();
+    }
+    EXPECT_LT(reads, trickle.chunkSize);
+  }
+
+  // A source that fails.
+  JsonStream failing([](char *, size_t) -> size_t {
+    throw std::runtime_error("Disk error");
+  });
+  EXPECT_FALSE(failing.next(record, err));
+  EXPECT_EQ(err, "Disk error");
+}
+
+#ifdef LIGHTJSON_WITH_ZLIB
+TEST(JsonStream, Gzip) {
+  std::string text;
+  for (int i = 0; i != 5000; ++i)
+    text += "{\"id\": " + std::to_string(i) + ", \"name\": \"user\"}\n";
+  const std::string compressed = gzip(text);
+  ASSERT_LT(compressed.size(), text.size() / 4);
+  StreamOptions options;
+  options.chunkSize = 4096;
+  std::string err;
+  JsonStream stream(stringSource(compressed, 1000), options);
+  auto records = readAll(stream, err);
+  EXPECT_EQ(err, "");
+  ASSERT_EQ(records.size(), 5000);
+  EXPECT_EQ(records[4999]["id"].toInt64(), 4999);
+
+  // Concatenated members, as `cat a.gz b.gz` writes them.
+  JsonStream concatenated(
+      stringSource(gzip("[1]\n") + gzip("[2]\n"), 3), options);
+  records = readAll(concatenated, err);
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_EQ(records[1][0].toInt64(), 2);
+
+  JsonStream document(stringSource(gzip("{\"a\": [1, 2]}"), 5));
+  EXPECT_EQ(document.parse(err)["a"].size(), 2);
+
+  JsonStream truncated(
+      stringSource(compressed.substr(0, compressed.size() / 2), 1000));
+  readAll(truncated, err);
+  EXPECT_EQ(err, "Truncated compressed data");
+  std::string corrupt = compressed;
+  corrupt[100] ^= 0x55;
+  corrupt[101] ^= 0x55;
+  err.clear();
+  JsonStream invalid(stringSource(corrupt, 1000));
+  readAll(invalid, err);
+  EXPECT_NE(err, "");
+}
+#endif
+
+#ifdef LIGHTJSON_WITH_ZSTD
+TEST(JsonStream, Zstd) {
+  std::string text;
+  for (int i = 0; i != 5000; ++i)
+    text += "{\"id\": " + std::to_string(i) + ", \"name\": \"user\"}\n";
+  const std::string compressed = zstd(text);
+  ASSERT_LT(compressed.size(), text.size() / 4);
+  StreamOptions options;
+  options.chunkSize = 4096;
+  std::string err;
+  JsonStream stream(stringSource(compressed, 1000), options);
+  auto records = readAll(stream, err);
+  EXPECT_EQ(err, "");
+  ASSERT_EQ(records.size(), 5000);
+  EXPECT_EQ(records[4999]["id"].toInt64(), 4999);
+
+  // Concatenated frames, as `cat a.zst b.zst` writes them.
+  JsonStream concatenated(
+      stringSource(zstd("[1]\n") + zstd("[2]\n"), 3), options);
+  records = readAll(concatenated, err);
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_EQ(records[1][0].toInt64(), 2);
+
+  options.compression = Compression::kZstd;
+  JsonStream document(stringSource(zstd("{\"a\": [1, 2]}"), 5), options);
+  EXPECT_EQ(document.parse(err)["a"].size(), 2);
+
+  JsonStream truncated(
+      stringSource(compressed.substr(0, compressed.size() / 2), 1000));
+  readAll(truncated, err);
+  EXPECT_EQ(err, "Truncated compressed data");
+  std::string corrupt = compressed;
+  corrupt[100] ^= 0x55;
+  corrupt[101] ^= 0x55;
+  err.clear();
+  JsonStream invalid(stringSource(corrupt, 1000));
+  readAll(invalid, err);
+  EXPECT_NE(err, "");
+}
+#endif
+
+TEST(ParsePool, Batch) {
+  std::vector<std::string> texts;
+  for (int i = 0; i != 200; ++i) {
+    // A few large documents among many small ones.
+    const size_t size = i % 50 == 0 ? 20000 : 3;
+    std::string text = "{\"i\": " + std::to_string(i) + ", \"v\": [";
+    for (size_t j = 0; j != size; ++j) text += j ? ",1" : "1";
+    texts.push_back(text + "]}");
+  }
+  texts[7] = "{\"i\": 7,";
+
+  ParsePool pool(3);
+  EXPECT_EQ(pool.threads(), 3);
+  auto futures = pool.parse(texts);
+  ASSERT_EQ(futures.size(), 200);
+  for (int i = 0; i != 200; ++i) {
+    auto result = futures[i].get();
+    if (i == 7) {
+      EXPECT_NE(result.error, "");
+      continue;
+    }
+    EXPECT_EQ(result.error, "") << i;
+    EXPECT_EQ(result.json["i"].toInt64(), i);
+    EXPECT_EQ(result.json["v"].size(), i % 50 == 0 ? 20000 : 3);
+  }
+
+  std::mutex mutex;
+  std::vector<int> seen(texts.size());
+  size_t errors = 0;
+  pool.parse(texts, [&](size_t index, ParseResult &&result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++seen[index];
+    if (!result.error.empty()) ++errors;
+  });
+  pool.wait();
+  EXPECT_EQ(std::count(seen.begin(), seen.end(), 1), 200);
+  EXPECT_EQ(errors, 1);
+  pool.parse(std::vector<std::string>(), [](size_t, ParseResult &&) {});
+  pool.wait();
+}
+
+TEST(ParseCache, Lru) {
+  const std::string a = "{\"a\": [1, 2, 3]}";
+  const std::string b = "{\"b\": \"" + std::string(100, 'x') + "\"}";
+  std::string err;
+  ParseCache cache(1 << 20);
+  const auto first = cache.parse(a, err);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first->root(), Json::parse(a, err));
+  // The same text, in another buffer, gets the same document.
+  EXPECT_EQ(cache.parse(std::string(a), err), first);
+  EXPECT_EQ(cache.parse(b, err)->root()["b"].toString(),
+            std::string(100, 'x'));
+  EXPECT_EQ(cache.parse("[", err), nullptr);
+  EXPECT_NE(err, "");
+  err.clear();
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_GT(stats.bytes, a.size() + b.size());
+
+  // Room for about two documents: touching |a| makes |b| the one to go.
+  const size_t budget = stats.bytes + 32;
+  ParseCache small(budget);
+  const auto kept = small.parse(a, err);
+  small.parse(b, err);
+  small.parse(a, err);
+  small.parse("{\"c\": null}", err);
+  stats = small.stats();
+  EXPECT_EQ(stats.evictions, 1);
+  EXPECT_LE(stats.bytes, budget);
+  EXPECT_EQ(small.parse(a, err), kept);
+  EXPECT_EQ(small.stats().hits, 2);
+  small.parse(b, err);
+  EXPECT_EQ(small.stats().misses, 4);
+  // Larger than the budget on its own, so parsed but not cached.
+  const std::string big = "[\"" + std::string(stats.bytes * 2, 'y') + "\"]";
+  EXPECT_EQ(small.parse(big, err)->root()[0].toString().size(),
+            stats.bytes * 2);
+  EXPECT_NE(small.parse(big, err), nullptr);
+  EXPECT_EQ(small.stats().misses, 6);
+  small.clear();
+  EXPECT_EQ(small.stats().entries, 0);
+  EXPECT_EQ(small.stats().bytes, 0);
+  // Evicted documents stay valid for whoever holds them.
+  EXPECT_EQ(kept->root()["a"][2].toInt64(), 3);
+
+  // Many threads on a few texts.
+  ParseCache shared(1 << 20);
+  std::vector<std::thread> threads;
+  for (int t = 0; t != 4; ++t) {
+    threads.emplace_back([&shared, t] {
+      std::string error;
+      for (int i = 0; i != 500; ++i) {
+        const int n = (i + t) % 7;
+        const std::string text = "{\"n\": " + std::to_string(n) + "}";
+        const auto json = shared.parse(text, error);
+        ASSERT_NE(json, nullptr);
+        ASSERT_EQ(json->root()["n"].toInt64(), n);
+      }
+    });
+  }
+  for (auto &thread: threads) thread.join();
+  stats = shared.stats();
+  EXPECT_EQ(stats.hits + stats.misses, 2000);
+  EXPECT_EQ(stats.entries, 7);
+  EXPECT_EQ(stats.evictions, 0);
+}
+
+TEST(Json, Allocations) {
+  std::string err;
+  const std::string longString = "\"" + std::string(100, 'l') + "\"";
+  const std::string numbers = "[1, 2, 3, 4, 5, 6, 7, 8]";
+  // 9 nodes, 6 members.
+  const std::string record =
+      "{\"id\": 1, \"name\": \"x\", \"tags\": [\"a\", \"b\"],"
+      " \"pos\": {\"x\": 1.5, \"y\": null}}";
+  ParseOptions unpacked;
+  unpacked.packArrays = false;
+  Json json;
+  // The node, with the string inside.
+  EXPECT_EQ(countAllocations([&] { json = Json::parse("\"short\"", err); }), 1);
+  // The node, its string, and the scratch buffer strings are decoded into.
+  EXPECT_EQ(countAllocations([&] { json = Json::parse(longString, err); }), 3);
+  // How often a vector or a hash table grows depends on the standard library,
+  // so only what every one of them must allocate is pinned down: a vector
+  // grows at most once per element, a hash table rehashes at most once per
+  // member.
+  // 9 nodes, the element vector and the parser's stack of open containers.
+  const size_t unpackedCount = countAllocations([&] {
+    json = Json::parse(numbers, err, unpacked);
+  });
+  EXPECT_GE(unpackedCount, 9 + 1 + 1);
+  EXPECT_LE(unpackedCount, 9 + 8 + 1);
+  // One node for the array, the packed values and the stack: fewer than one
+  // per element.
+  const size_t packedCount =
+      countAllocations([&] { json = Json::parse(numbers, err); });
+  EXPECT_GE(packedCount, 1 + 1 + 1);
+  EXPECT_LT(packedCount, 8);
+  // 9 nodes, 6 members, 2 bucket arrays, the "tags" vector and the stack,
+  // which holds at most 2 open containers.
+  const size_t recordCount =
+      countAllocations([&] { json = Json::parse(record, err); });
+  EXPECT_GE(recordCount, 9 + 6 + 2 + 1 + 1);
+  EXPECT_LE(recordCount, 9 + 6 + 2 + 6 + 2 + 2);
+  // Once a context has seen the shape, only the members are allocated.
+  ParserContext context;
+  for (int i = 0; i != 3; ++i) {
+    const size_t count =
+        countAllocations([&] { json = context.parse(record, err); });
+    if (i) {
+      EXPECT_EQ(count, 6);
+    }
+    context.recycle(std::move(json));
+  }
+
+  // Values are moved into the tree, never copied.
+  std::string text(100, 't');
+  EXPECT_EQ(countAllocations([&] { json = Json(std::move(text)); }), 1);
+  Json::array items(8);
+  EXPECT_EQ(countAllocations([&] { json = Json(std::move(items)); }), 1);
+  EXPECT_EQ(countAllocations([&] { Json moved(std::move(json)); }), 0);
+  json = Json(Json::array());
+  text.assign(100, 't');
+  // The node and the element vector.
+  EXPECT_EQ(countAllocations([&] { json.emplace_back(std::move(text)); }), 2);
+}
+
+TEST(Json, Reparse) {
+  std::string text =
+      "{\"name\": \"doc\", \"nums\": [1, 2, 3],"
+      " \"items\": [{\"id\": 10, \"tags\": [\"a\", \"b\"]}, {\"id\": 20}],"
+      " \"meta\": {\"size\": 1234, \"ok\": true}}";
+  std::string err;
+  auto json = Json::parse(text, err);
+  const auto *nums = json["nums"].packedNumbers();
+  ASSERT_NE(nums, nullptr);
+
+  // Inside the second tag: only that string is parsed again.
+  ASSERT_TRUE(Json::reparse(json, text, {text.find("\"b\"") + 1, 1, "bee"},
+                            err));
+  EXPECT_EQ(json["items"][0]["tags"][1].toString(), "bee");
+  EXPECT_EQ(json["nums"].packedNumbers(), nums);
+  // A new member of a nested object.
+  ASSERT_TRUE(Json::reparse(json, text, {text.find("1234") + 4, 0,
+                                         ", \"new\": [null]"}, err));
+  EXPECT_TRUE(json["meta"]["new"][0].isNull());
+  EXPECT_EQ(json, Json::parse(text, err));
+  EXPECT_EQ(json["nums"].packedNumbers(), nums);
+  // Inside a packed array, which is parsed again whole and stays packed.
+  ASSERT_TRUE(Json::reparse(json, text, {text.find("2, 3"), 1, "2.5"}, err));
+  ASSERT_NE(json["nums"].packedNumbers(), nullptr);
+  EXPECT_EQ(json["nums"][1].toNumber(), 2.5);
+
+  // Closing the string changes the structure around it, and breaks it.
+  const std::string before = text;
+  EXPECT_FALSE(Json::reparse(json, text, {text.find("doc") + 1, 0, "\""},
+                             err));
+  EXPECT_NE(err, "");
+  EXPECT_NE(text, before);
+  EXPECT_FALSE(Json::reparse(json, text, {text.size() + 1, 0, "x"}, err));
+  EXPECT_EQ(err, "Edit out of range");
+
+  // Only the last of duplicate keys is in the tree.
+  text = "{\"a\": [1, \"x\"], \"a\": [2, \"y\"]}";
+  json = Json::parse(text, err);
+  ASSERT_TRUE(Json::reparse(json, text, {text.find("x"), 1, "z"}, err));
+  EXPECT_EQ(json["a"][1].toString(), "y");
+
+  // Random edits give the same tree as a full parse, or the same failure.
+  std::mt19937 rng(7);
+  const std::string pieces[] = {"1", "\"", ",", "[", "]", "{", "}", ":", " ",
+                                "e", "-", "\\", "true", "\"k\": 0, "};
+  text = "{\"a\": [1, 2.5, {\"b\": \"str\\u00e9ing\", \"c\": [true, null]}],"
+         " \"d\": {\"e\": {\"f\": [[1], [2, [3]]], \"g\": \"h\"}}, \"i\": -7}";
+  json = Json::parse(text, err);
+  for (int i = 0; i != 2000; ++i) {
+    const size_t offset = rng() % (text.size() + 1);
+    const size_t removed = std::min<size_t>(rng() % 3, text.size() - offset);
+    const TextEdit edit{offset, removed, rng() % 3 ? pieces[rng() % 14] : ""};
+    std::string expected = text;
+    expected.replace(offset, removed, edit.inserted);
+    std::string fullError;
+    const auto full = Json::parse(expected, fullError);
+    std::string reparseError;
+    const bool ok = Json::reparse(json, text, edit, reparseError);
+    ASSERT_EQ(text, expected);
+    ASSERT_EQ(ok, fullError.empty()) << text;
+    if (ok) {
+      ASSERT_EQ(json, full) << text;
+      ASSERT_EQ(json.serialize(), full.serialize()) << text;
+    } else {
+      EXPECT_EQ(reparseError, fullError);
+      // Back to a valid document.
+      text = "{\"a\": [1, {\"b\": [\"c\", 2]}], \"d\": {\"e\": \"f\"}}";
+      json = Json::parse(text, err);
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();